@@ -0,0 +1,135 @@
+#!/bin/sh
+#
+# check_csim.sh - Regression check of the equivalent modes of the simulator
+#
+# Usage: ./check_csim.sh [trace ...]
+#
+# csim.c is built with and without the SIMD tag matching (-DCSIM_NO_SIMD), and
+# the results of every trace for several geometries and policies must be the
+# same in the serial mode, with -j and -P, after a conversion to the binary
+# format, with the scalar build and in a single level hierarchy (-L). The
+# results of the -g sweeps and of the -d and -f stack distance modes must be
+# the ones of the serial runs of their geometries.
+# The traces are the passed ones, the ones of the traces directory of the lab
+# if there is no argument, and synthetic ones written by --generate otherwise.
+# cachelab.c and cachelab.h of the lab must be next to csim.c.
+
+cd "$(dirname "$0")" || exit 1
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:-"-O2 -Wall"}
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+$CC $CFLAGS -o "$work/csim" csim.c cachelab.c -lm -pthread || exit 1
+$CC $CFLAGS -DCSIM_NO_SIMD -o "$work/csim-scalar" csim.c cachelab.c -lm -pthread || exit 1
+
+if [ $# -eq 0 ]; then
+    set -- traces/*.trace
+    if [ ! -f "$1" ]; then
+        set --
+        for pattern in sequential strided uniform zipf pointer-chase transpose; do
+            "$work/csim" --generate $pattern --accesses 200000 --footprint 4194304 \
+                > "$work/$pattern.trace" || exit 1
+            set -- "$@" "$work/$pattern.trace"
+        done
+    fi
+fi
+
+# s, E and b of the checked geometries: the ones of at least 8 lines use the SIMD matching
+geometries="1,2,4 4,1,4 2,4,3 5,2,5 8,3,6 3,8,4 4,16,5 1,64,6"
+policies="lru fifo random plru lfu srrip brrip"
+# Policies simulated together in one sweep (plru rejects the associativity 3)
+sweep_policies="lru fifo random lfu srrip brrip"
+# The sets are sharded among the -j threads: 16 threads are more than the sets of some geometries
+threads_nums="2 4 16"
+# The batches of the -P parsers must be simulated in order, whatever their number
+parsers_nums="1 3 8"
+failures=0
+
+# Compares the output of a mode ($3) with the serial one ($2)
+check() {
+    if [ "$2" != "$3" ]; then
+        echo "FAIL $1"
+        echo "  expected: $2"
+        echo "  got:      $3"
+        failures=$((failures + 1))
+    fi
+}
+
+for trace in "$@"; do
+    binary="$work/$(basename "$trace").bin"
+    "$work/csim" -t "$trace" --convert "$binary" > /dev/null || exit 1
+    # Converting a binary trace again must give the same bytes
+    "$work/csim" -t "$binary" --convert "$binary.again" > /dev/null || exit 1
+    if ! cmp -s "$binary" "$binary.again"; then
+        echo "FAIL $trace binary round trip"
+        failures=$((failures + 1))
+    fi
+    sweep_args=""
+    sweep_expected=""
+    policies_sweep_expected=""
+    for geometry in $geometries; do
+        IFS=, read s e b <<EOF
+$geometry
+EOF
+        for policy in $policies; do
+            name="$trace -s $s -E $e -b $b -r $policy"
+            serial=$("$work/csim" -s $s -E $e -b $b -r $policy -t "$trace")
+            for threads in $threads_nums; do
+                check "$name -j $threads" "$serial" \
+                    "$("$work/csim" -s $s -E $e -b $b -r $policy -t "$trace" -j $threads)"
+            done
+            for parsers in $parsers_nums; do
+                check "$name -P $parsers" "$serial" \
+                    "$("$work/csim" -s $s -E $e -b $b -r $policy -t "$trace" -P $parsers)"
+            done
+            check "$name binary" "$serial" "$("$work/csim" -s $s -E $e -b $b -r $policy -t "$binary")"
+            check "$name scalar" "$serial" "$("$work/csim-scalar" -s $s -E $e -b $b -r $policy -t "$trace")"
+            # A single level of the hierarchy scans its sets without the kernels
+            # specialized per associativity (the geometry is rejected for plru if E=3)
+            case " $sweep_policies " in *" $policy "*)
+                policies_sweep_expected="$policies_sweep_expected
+policy:$policy s:$s E:$e b:$b $serial"
+            esac
+            case "$serial" in hits:*)
+                check "$name -L" "L1 s:$s E:$e b:$b policy:$policy $serial" \
+                    "$("$work/csim" -L $s,$e,$b,$policy -t "$trace")"
+            esac
+        done
+        serial=$("$work/csim" -s $s -E $e -b $b -t "$trace")
+        sweep_args="$sweep_args -g $geometry"
+        sweep_expected="$sweep_expected
+s:$s E:$e b:$b $serial"
+        distances=""
+        for associativity in $(seq 1 $e); do
+            distances="$distances
+s:$s E:$associativity b:$b $("$work/csim" -s $s -E $associativity -b $b -t "$trace")"
+        done
+        check "$trace -s $s -b $b -d $e" "${distances#?}" "$("$work/csim" -s $s -b $b -d $e -t "$trace")"
+    done
+    check "$trace$sweep_args" "${sweep_expected#?}" "$("$work/csim" $sweep_args -t "$trace")"
+    check "$trace$sweep_args -j 4" "${sweep_expected#?}" "$("$work/csim" $sweep_args -t "$trace" -j 4)"
+    sweep_args="$sweep_args -r $(echo $sweep_policies | tr ' ' ',')"
+    check "$trace$sweep_args" "${policies_sweep_expected#?}" "$("$work/csim" $sweep_args -t "$trace")"
+    check "$trace$sweep_args -j 4" "${policies_sweep_expected#?}" \
+        "$("$work/csim" $sweep_args -t "$trace" -j 4)"
+
+    # The reuse curve (-f) gives the results of fully associative caches (s = 0)
+    reuse=$("$work/csim" -b 5 -f -t "$trace")
+    reuse_expected=""
+    reuse_results=""
+    for associativity in 1 2 4 8 16 32 64; do
+        reuse_line=$(echo "$reuse" | grep "^lines:$associativity ") || break
+        reuse_results="$reuse_results
+$reuse_line"
+        reuse_expected="$reuse_expected
+lines:$associativity $("$work/csim" -g 0,$associativity,5 -t "$trace" | sed 's/^s:0 E:[0-9]* b:5 //')"
+    done
+    check "$trace -b 5 -f" "${reuse_expected#?}" "${reuse_results#?}"
+done
+
+if [ $failures -ne 0 ]; then
+    echo "$failures checks failed"
+    exit 1
+fi
+echo "All checks passed"
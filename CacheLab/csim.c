@@ -4,62 +4,192 @@
 ******************************
 */
 
-#include "cachelab.h"
+# define _GNU_SOURCE  // memrchr
+#ifndef CSIM_LIBRARY
+#include "cachelab.h"  // printSummary
+#endif
+#include "csim.h"
 #include <getopt.h>
-#include <stdlib.h>  // malloc, exit, strtol
+#include <stdlib.h>  // malloc, posix_memalign, exit, strtol
 #include <assert.h>  // assert
-#include <string.h>  // strlen
+#include <string.h>  // strlen, strchr, memchr, memrchr, memcmp, memcpy, memmove, memset
 #include <stdio.h>  // printf, FILE
+#include <math.h>  // sqrt
+#include <stddef.h>  // offsetof
 #include <unistd.h>  // dir
+#include <time.h>  // clock_gettime
+#include <pthread.h>  // pthread_create, pthread_barrier_wait
+#include <sched.h>  // sched_yield
+#include <stdatomic.h>  // atomic_load_explicit, atomic_store_explicit
+#include <sys/mman.h>  // mmap, munmap, madvise
+#include <sys/stat.h>  // fstat
+#include <sys/resource.h>  // getrusage
+#if defined(__x86_64__) && !defined(CSIM_NO_SIMD)  // -DCSIM_NO_SIMD compares the tags one by one
+# define CSIM_X86_SIMD
+#include <immintrin.h>  // _mm_cmpeq_epi32, _mm256_cmpeq_epi64
+#endif
+#ifdef CSIM_HAVE_ZLIB
+#include <zlib.h>  // gzdopen, gzread
+#endif
+#ifdef CSIM_HAVE_ZSTD
+#include <zstd.h>  // ZSTD_decompressStream
+#endif
 
 /* We will use this constant to generate masks later */
-# define ADDRESS_BIT_LENGTH 32
+# define ADDRESS_BIT_LENGTH 64
 
+/* Limits of the numerical parameters: the associativity is limited by
+    the masks of 64 bits used for the lines of a set */
+# define NUMERICAL_PARAM_MAX 25
+# define MAX_ASSOCIATIVITY 64
 
-/* GLOBAL VARIABLES SECTION */
+/* Limit of the number of threads passed with -j and -P */
+# define MAX_THREADS_NUM 1024
 
-/* We will be stroing masks after their computation 
-    to not recompute them again.  */
-unsigned long *set_index_mask = NULL;
-unsigned long *block_offset_mask = NULL;
-unsigned long *line_tag_mask = NULL;
 
-/* In these variables the results of cache modeling
-    will be stored */
-int cache_hits = 0;
-int cache_misses = 0;
-int cache_evictions = 0;
+/* STRUCTURES DESCRIPTION SECTION */
 
-/* END OF GLOBAL VARIABLES SECTION */
+struct cache_geometry {
+/*
+    Structure to store the parameters of a modeled cache.
+    We are using chars here as we assume that the values
+    are not bigger than 1 byte.
+*/
+    char set_index_bits_num;
+    char associativity_num;
+    char block_bits_num;
+};
 
+struct cache_statistics {
+/*
+    Structure where the results of cache modeling are stored.
+*/
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
 
-/* STRUCTURES DESCRIPTION SECTION */
+struct write_policy {
+/*
+    Structure to store how the cache handles stores: a write-back cache
+    marks the line dirty and writes it to the next level when it is evicted,
+    a write-through one writes every store to the next level. A store that
+    misses in a no-write-allocate cache goes to the next level only.
+*/
+    int write_back;
+    int write_allocate;
+};
 
-struct cache_line {
+struct prefetch_statistics {
 /*
-    Structure that represents line in cache sets.
+    Structure where the results of the prefetcher are stored, apart from
+    the demand accesses: a prefetched line is useful if a demand access uses it,
+    late if that access came before the prefetch could complete and polluting
+    if it was evicted without being used.
 */
-    int valid_bit;
-    int tag;
-    int age;  // field to implement the LRU cache policy
-    long *bytes;  // this field is not currently used
+    unsigned long issued;
+    unsigned long useful;
+    unsigned long late;
+    unsigned long polluting;
 };
 
-struct set {
+struct write_statistics {
 /*
-    Structure that represents cache set.
+    Structure where the traffic between the cache and the next level is stored.
 */
-    long index;
-    int number_of_lines;
-    struct cache_line *lines;
+    unsigned long writebacks;
+    unsigned long bytes_read;
+    unsigned long bytes_written;
 };
 
 struct cache_model {
 /*
-    Structure that represents cache.
+    Structure that represents cache. The lines of all sets are stored
+    set after set in flat arrays, so the lines of a set are contiguous
+    in memory. No data is stored for the lines: the simulation needs
+    only their tags.
 */
-    struct set *sets;
     int number_of_sets;
+    int number_of_lines;  // number of lines in a set
+    unsigned long *tags;
+    /* Function comparing the tags of a set with vector instructions,
+        NULL if the lines are compared one by one */
+    unsigned long long (*match_tags)(const unsigned long *set_tags, int number_of_lines,
+                                        unsigned long line_tag);
+    unsigned long long *valid_lines;  // one mask per set, bit i is the valid bit of line i
+    /* Allocated only if the stores are modeled, NULL otherwise */
+    unsigned long long *dirty_lines;  // one mask per set, bit i is the dirty bit of line i
+    /* Allocated only if a prefetcher is modeled, NULL otherwise */
+    unsigned long long *prefetched_lines;  // one mask per set, lines prefetched and not used yet
+    unsigned long *prefetch_clock;  // clock of the prefetch of every line
+    /* The replacement policy keeps its metadata in a value per line and
+        a value per set, their meaning depends on the policy */
+    const struct replacement_policy *policy;
+    unsigned long *line_state;
+    unsigned long long *set_state;
+    unsigned long seed;  // used by the random policy
+    /* Access clock: incremented on every access to the cache */
+    unsigned long clock;
+    struct cache_statistics statistics;
+    struct write_policy write_policy;
+    struct write_statistics write_statistics;
+    struct prefetch_statistics prefetch_statistics;
+    unsigned long line_size;  // in bytes, used to count the traffic
+    void *memory;  // the block where the arrays above are allocated
+};
+
+struct replacement_policy {
+/*
+    Structure that describes a replacement policy: its name and the functions
+    called when a line is filled, when a line is hit and when a line of a full
+    set has to be chosen for eviction.
+*/
+    const char *name;
+    void (*on_fill)(struct cache_model *cache, long set_index, int line_index);
+    void (*on_hit)(struct cache_model *cache, long set_index, int line_index);
+    int (*choose_victim)(struct cache_model *cache, long set_index, long line_tag);
+};
+
+/* This enum represents how the contents of the levels of a cache hierarchy
+    are related: a line of an inclusive level is also in all the levels below,
+    a line of an exclusive hierarchy is in one level only, and nothing is
+    enforced in a non-inclusive non-exclusive (NINE) hierarchy. */
+enum InclusionPolicy {NINE, INCLUSIVE, EXCLUSIVE};
+
+/* Maximal number of cores (one per trace) of the multicore mode */
+# define MAX_CORES_NUM 64
+
+/* This enum represents the access pattern of a generated trace */
+enum TracePattern {NO_PATTERN, SEQUENTIAL_PATTERN, STRIDED_PATTERN, UNIFORM_PATTERN,
+                    ZIPF_PATTERN, POINTER_CHASE_PATTERN, TRANSPOSE_PATTERN};
+
+# define GENERATED_DEFAULT_ACCESSES (1UL << 20)
+# define GENERATED_DEFAULT_FOOTPRINT (1UL << 20)
+# define GENERATED_DEFAULT_STRIDE 64
+
+/* This enum represents the prefetcher modeled with the cache */
+enum PrefetcherKind {NO_PREFETCHER, NEXT_LINE_PREFETCHER, STRIDE_PREFETCHER, STREAM_PREFETCHER};
+
+# define PREFETCH_DEFAULT_DEGREE 2
+# define PREFETCH_DEFAULT_LATENCY 10
+
+/* Default size of the pages translated by the TLB */
+# define PAGE_DEFAULT_SIZE 4096
+
+struct tlb_level_args {
+/*
+    Structure to store the parameters of a level of the TLB.
+*/
+    unsigned long entries_num;
+    int associativity_num;
+};
+
+struct hierarchy_level_args {
+/*
+    Structure to store the parameters of a level of the cache hierarchy.
+*/
+    struct cache_geometry geometry;
+    const struct replacement_policy *policy;
 };
 
 struct passed_args {
@@ -68,6 +198,7 @@ struct passed_args {
 */
     int help_flag;
     int verbose_flag;
+    int performance_flag;
 
     /* We are using chars here as we assume 
         that the values are not bigger than 1 byte */
@@ -76,11 +207,95 @@ struct passed_args {
     char block_bits_num;
 
     char *trace_file;
+    /* Every -t adds a trace, several traces are the cores of a multicore system */
+    char **trace_files;
+    int trace_files_num;
+
+    /* Geometries passed with -g. If there is any, the sweep mode is used */
+    struct cache_geometry *sweep_geometries;
+    int sweep_geometries_num;
+    int threads_num;
+    int pipeline_parsers_num;  // pipeline mode is used if not 0
+
+    /* Stack distance mode: the maximal associativity passed with -d
+        and the flag of the fully associative reuse curve (-f) */
+    char stack_distance_max;
+    int reuse_curve_flag;
+
+    /* Misses are classified into compulsory, capacity and conflict ones (-c) */
+    int classify_flag;
+
+    /* Stores are modeled with this write policy if the flag is set */
+    int write_modeling_flag;
+    struct write_policy write_policy;
+
+    /* Prefetcher: its kind, the number of lines prefetched at once
+        and the latency of a prefetch in accesses */
+    enum PrefetcherKind prefetcher_kind;
+    unsigned long prefetch_degree;
+    unsigned long prefetch_latency;
+    int prefetch_params_flag;  // --prefetch-degree or --prefetch-latency was passed
+
+    /* Replacement policies passed with -r (LRU if none is passed)
+        and the seed of the random policy */
+    const struct replacement_policy **policies;
+    int policies_num;
+    unsigned long seed;
+
+    /* Hierarchy mode: levels passed with -L (from L1), the inclusion
+        policy and the latencies of the levels and of the memory */
+    struct hierarchy_level_args *levels;
+    int levels_num;
+    enum InclusionPolicy inclusion;
+    int inclusion_flag;  // --inclusion was passed
+    unsigned long *latencies;
+    int latencies_num;
+
+    char *convert_file;  // the trace is converted to this binary trace
+
+    /* Set sampling mode: one set in sample_rate on average is simulated (--sample) */
+    unsigned long sample_rate;
+
+    /* Trace generation: the pattern, the number of accesses, the size
+        of the accessed memory and the stride in bytes */
+    enum TracePattern trace_pattern;
+    unsigned long generated_accesses_num;
+    unsigned long generated_footprint;
+    unsigned long generated_stride;
+
+    /* The parsing and simulation times of every geometry are measured (--benchmark) */
+    int benchmark_flag;
+
+    /* A fully associative victim cache of this number of lines is modeled
+        behind the cache if it is not 0 (--victim) */
+    unsigned long victim_lines_num;
+
+    /* TLB levels passed with --tlb (from L1) and the size of the pages */
+    struct tlb_level_args *tlb_levels;
+    int tlb_levels_num;
+    unsigned long page_size;
+    int page_size_flag;  // --page-size was passed
+
+    /* Instruction fetches are modeled if the flag is set: by a separate cache
+        of the icache geometry (--icache) or by the data cache (--unified) */
+    int instructions_flag;
+    int unified_flag;
+    struct cache_geometry icache_geometry;
+
+    /* Time series: the results of every window of window_size accesses are
+        written as CSV (or JSON lines) to the output file (standard output if NULL),
+        with the number of valid lines of every set if the occupancy flag is set */
+    unsigned long window_size;
+    int window_json_flag;
+    char *window_output_file;
+    int window_occupancy_flag;
+    int window_params_flag;  // --window-format, --window-output or --window-occupancy was passed
 };
 
 /* This enum is used during trace file parsing.
-    It represents the set of operations with data. */
-enum MemoryAccessOperation {M, L, S};
+    It represents the set of operations with data and the instruction
+    fetches (I), which are read only if they are modeled. */
+enum MemoryAccessOperation {M, L, S, I};
 
 struct file_line {
 /*
@@ -88,6 +303,7 @@ struct file_line {
 */
     enum MemoryAccessOperation operation;
     unsigned long address;
+    unsigned int size;  // number of bytes accessed
 };
 
 struct address_separated {
@@ -96,40 +312,324 @@ struct address_separated {
     find its cache location.
 */
     long set_index;
-    long line_index;
+    long line_tag;
     long block_offset;
 };
 
+struct address_decoder {
+/*
+    Structure to store the masks and the shifts used to separate addresses.
+    It is computed once from the passed arguments and then passed by value,
+    so separating an address needs neither memory allocations nor
+    the arguments structure.
+*/
+    unsigned long set_index_mask;
+    unsigned long line_tag_mask;
+    unsigned long block_offset_mask;
+    char set_index_shift;
+    char line_tag_shift;
+};
+
 /* STRUCTURES DESCRIPTION SECTION END */
 
 
+/* REPLACEMENT POLICIES SECTION */
+
+static unsigned long *get_set_line_state(struct cache_model *cache, long set_index) {
+    return &(cache->line_state[set_index * cache->number_of_lines]);
+}
+
+static int get_min_state_line(struct cache_model *cache, long set_index) {
+/*
+    Function to find the line of the set with the smallest state value
+    (the first one if there are several)
+*/
+    unsigned long *set_line_state = get_set_line_state(cache, set_index);
+    unsigned long min_state = set_line_state[0];
+    int min_index = 0;
+    int i;
+    for (i = 1; i < cache->number_of_lines; i++) {
+        if (set_line_state[i] < min_state) {
+            min_state = set_line_state[i];
+            min_index = i;
+        }
+    }
+    return min_index;
+}
+
+/* LRU: the line state is the clock value of the last access, so the least
+    recently used line of a set is the one with the smallest value. */
+
+static void lru_on_access(struct cache_model *cache, long set_index, int line_index) {
+    get_set_line_state(cache, set_index)[line_index] = cache->clock;
+}
+
+static int get_lru_line(struct cache_model *cache, long set_index, long line_tag) {
+/*
+    Function to choose a line in a set of cache lines according to the
+    LRU cache policy
+*/
+    (void)line_tag;  // only the random policy uses the incoming tag
+    return get_min_state_line(cache, set_index);
+}
+
+/* FIFO: the set state counts the fills of the set and the line state is
+    the number of the fill of the line, so the line filled first has the smallest
+    value. Lines may be invalidated and filled again in any order, so the victim
+    is not simply the next line index. */
+
+static void keep_state(struct cache_model *cache, long set_index, int line_index) {
+/*
+    Function used by the policies that do not change their state on fills or on hits
+*/
+    (void)cache;
+    (void)set_index;
+    (void)line_index;
+}
+
+static void fifo_on_fill(struct cache_model *cache, long set_index, int line_index) {
+    get_set_line_state(cache, set_index)[line_index] = cache->set_state[set_index]++;
+}
+
+static int get_fifo_line(struct cache_model *cache, long set_index, long line_tag) {
+    (void)line_tag;
+    return get_min_state_line(cache, set_index);
+}
+
+/* Random: the set state counts the evictions of the set. The victim is
+    a hash of the seed, this counter and the incoming tag, so the choice
+    does not depend on the accesses to the other sets. */
+
+static unsigned long mix_bits(unsigned long value) {
+/*
+    Function to mix the bits of a value (the finalizer of the splitmix64 generator)
+*/
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9UL;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBUL;
+    value ^= value >> 31;
+    return value;
+}
+
+static int get_random_line(struct cache_model *cache, long set_index, long line_tag) {
+    unsigned long draw = cache->set_state[set_index]++;
+    return mix_bits(cache->seed ^ mix_bits(draw * 0x9E3779B97F4A7C15UL + line_tag))
+            % cache->number_of_lines;
+}
+
+/* Tree pseudo-LRU: the set state stores the nodes of a binary tree over the
+    lines (node i has children 2i and 2i + 1, the leaves are the nodes
+    E .. 2E - 1). A node bit tells in which half the victim is to be searched.
+    The associativity must be a power of two. */
+
+static void plru_on_access(struct cache_model *cache, long set_index, int line_index) {
+    unsigned long long tree = cache->set_state[set_index];
+    int node = cache->number_of_lines + line_index;
+    while (node > 1) {
+        /* The parent is pointed to the other half */
+        if (node & 1) {
+            tree &= ~(1ULL << (node >> 1));
+        } else {
+            tree |= 1ULL << (node >> 1);
+        }
+        node >>= 1;
+    }
+    cache->set_state[set_index] = tree;
+}
+
+static int get_plru_line(struct cache_model *cache, long set_index, long line_tag) {
+    (void)line_tag;
+    unsigned long long tree = cache->set_state[set_index];
+    int node = 1;
+    while (node < cache->number_of_lines) {
+        node = 2 * node + ((tree >> node) & 1);
+    }
+    return node - cache->number_of_lines;
+}
+
+/* LFU: the line state counts the accesses to the line since it was filled. */
+
+static void lfu_on_fill(struct cache_model *cache, long set_index, int line_index) {
+    get_set_line_state(cache, set_index)[line_index] = 1;
+}
+
+static void lfu_on_hit(struct cache_model *cache, long set_index, int line_index) {
+    get_set_line_state(cache, set_index)[line_index] += 1;
+}
+
+static int get_lfu_line(struct cache_model *cache, long set_index, long line_tag) {
+    (void)line_tag;
+    return get_min_state_line(cache, set_index);
+}
+
+/* RRIP: the line state is a 2 bits re-reference prediction value (RRPV).
+    A hit predicts a near re-reference (0), the victim is a line with
+    a distant prediction (3). SRRIP fills lines with a long prediction (2),
+    BRRIP with a distant one except for every 32th fill of the set
+    (counted in the set state). */
+
+# define RRPV_DISTANT 3
+# define RRPV_LONG 2
+# define BRRIP_LONG_FILL_PERIOD 32
+
+static void srrip_on_fill(struct cache_model *cache, long set_index, int line_index) {
+    get_set_line_state(cache, set_index)[line_index] = RRPV_LONG;
+}
+
+static void brrip_on_fill(struct cache_model *cache, long set_index, int line_index) {
+    unsigned long long fills = cache->set_state[set_index]++;
+    get_set_line_state(cache, set_index)[line_index] =
+        (0 == fills % BRRIP_LONG_FILL_PERIOD) ? RRPV_LONG : RRPV_DISTANT;
+}
+
+static void rrip_on_hit(struct cache_model *cache, long set_index, int line_index) {
+    get_set_line_state(cache, set_index)[line_index] = 0;
+}
+
+static int get_rrip_line(struct cache_model *cache, long set_index, long line_tag) {
+    (void)line_tag;
+    unsigned long *set_line_state = get_set_line_state(cache, set_index);
+    int i;
+    while (1) {
+        for (i = 0; i < cache->number_of_lines; i++) {
+            if (RRPV_DISTANT == set_line_state[i]) {
+                return i;
+            }
+        }
+        /* No line is predicted to be distant: all lines are aged */
+        for (i = 0; i < cache->number_of_lines; i++) {
+            set_line_state[i]++;
+        }
+    }
+}
+
+# define REPLACEMENT_POLICIES_NUM 7
+
+static const struct replacement_policy replacement_policies[REPLACEMENT_POLICIES_NUM] = {
+    {"lru", lru_on_access, lru_on_access, get_lru_line},
+    {"fifo", fifo_on_fill, keep_state, get_fifo_line},
+    {"random", keep_state, keep_state, get_random_line},
+    {"plru", plru_on_access, plru_on_access, get_plru_line},
+    {"lfu", lfu_on_fill, lfu_on_hit, get_lfu_line},
+    {"srrip", srrip_on_fill, rrip_on_hit, get_rrip_line},
+    {"brrip", brrip_on_fill, rrip_on_hit, get_rrip_line}
+};
+
+/* The policy used when no policy is passed */
+# define DEFAULT_POLICY (&(replacement_policies[0]))
+
+static const struct replacement_policy *find_replacement_policy(const char *name) {
+/*
+    Function to get the replacement policy by its name. Returns NULL if there is no such policy.
+*/
+    int i;
+    for (i = 0; i < REPLACEMENT_POLICIES_NUM; i++) {
+        if (0 == strcmp(replacement_policies[i].name, name)) {
+            return &(replacement_policies[i]);
+        }
+    }
+    return NULL;
+}
+
+static int is_policy_geometry_valid(const struct replacement_policy *policy, int associativity_num) {
+/*
+    Function to check that the associativity can be used with the passed policy:
+    the tree of the plru policy needs a power of two
+*/
+    return get_plru_line != policy->choose_victim
+            || 0 == (associativity_num & (associativity_num - 1));
+}
+
+/* END OF REPLACEMENT POLICIES SECTION */
+
+
+/* The command line tool is left out of the library (built with -DCSIM_LIBRARY),
+    which keeps only the cache model, the policies and the accesses */
+#ifndef CSIM_LIBRARY
+
 /* ARGUMENTS PARSING SECTION  */
 
-void print_help () {
+static void print_help () {
     printf("USAGE:\n");
     printf("\t-s <numerical_param>\tNumber of set index bits\n");
-    printf("\t-E <numerical_param>\tAssociativity (number of lines per set)\n");
+    printf("\t-E <numerical_param>\tAssociativity (number of lines per set, at most 64)\n");
     printf("\t-b <numerical_param>\tNumber of block bits\n");
-    printf("\t-t <tracefile>\tName of the valgring trace to replay\n");
+    printf("\t-t <tracefile>\tName of the valgring trace to replay. If the option is repeated,\n");
+    printf("\t\t\tevery trace runs on a core with a private cache kept coherent with MESI\n");
+    printf("\t-g <s,E,b>\tSweep mode: simulate this geometry too. Each value may be\n");
+    printf("\t\t\ta range \"low-high\". The option may be repeated (replaces -s, -E, -b)\n");
+    printf("\t-j <numerical_param>\tNumber of worker threads (optional). The sets of the cache\n");
+    printf("\t\t\tare distributed among them, or the geometries in the sweep mode\n");
+    printf("\t-P <numerical_param>\tPipeline mode: reading, parsing (with this number of threads)\n");
+    printf("\t\t\tand simulation of a text trace overlap (optional)\n");
+    printf("\t-d <numerical_param>\tStack distance mode: results for every associativity\n");
+    printf("\t\t\tfrom 1 to the passed one with the -s and -b geometry\n");
+    printf("\t-f\tStack distance mode: miss curve of fully associative caches with -b blocks.\n");
+    printf("\t\t\tBoth modes model LRU caches in a single thread (no -r, -j, -P, -g or -L)\n");
+    printf("\t--write <back|through>\tModel the stores with a write-back (default) or write-through\n");
+    printf("\t\t\tpolicy and print the traffic to the next level (optional)\n");
+    printf("\t--no-write-allocate\tStores that miss do not bring the line in the cache (optional)\n");
+    printf("\t--prefetch <next-line|stride|stream>\tModel a prefetcher and print its statistics (optional)\n");
+    printf("\t--prefetch-degree <numerical_param>\tNumber of lines prefetched at once (default 2)\n");
+    printf("\t--prefetch-latency <numerical_param>\tAccesses before a prefetch completes (default 10).\n");
+    printf("\t\t\tAn access to a line whose prefetch is not complete counts as a miss\n");
+    printf("\t--sample <numerical_param>\tSimulate one set in this number (chosen by hashing the set\n");
+    printf("\t\t\tindex with the seed) and extrapolate the results with 95%% confidence intervals\n");
+    printf("\t--victim <numerical_param>\tModel a fully associative victim cache of this number\n");
+    printf("\t\t\tof lines (at most 64) behind the cache (optional)\n");
+    printf("\t--tlb <entries,ways>\tAdd a TLB level (the first one is L1) and print its statistics.\n");
+    printf("\t\t\tThe option is repeated for every level (optional)\n");
+    printf("\t--page-size <numerical_param>\tSize of the pages translated by the TLB (default 4096)\n");
+    printf("\t--icache <s,E,b>\tModel the instruction fetches (I lines) with a separate\n");
+    printf("\t\t\tinstruction cache of this geometry and print its statistics (optional)\n");
+    printf("\t--unified\tModel the instruction fetches with the data cache (optional)\n");
+    printf("\t--window <numerical_param>\tWrite the hits, misses and evictions of every window of\n");
+    printf("\t\t\tthis number of accesses to the -s, -E, -b cache (optional)\n");
+    printf("\t--window-format <csv|json>\tFormat of the windows: CSV (default) or JSON lines\n");
+    printf("\t--window-output <file>\tFile where the windows are written (default standard output)\n");
+    printf("\t--window-occupancy\tAdd the number of valid lines of every set to the windows\n");
+    printf("\t-c\tClassify the misses into compulsory, capacity and conflict ones\n");
+    printf("\t\t\tand print the sets with the most conflict misses (optional)\n");
+    printf("\t-r <policy>[,<policy>...]\tReplacement policy: lru (default), fifo, random, plru,\n");
+    printf("\t\t\tlfu, srrip or brrip. Several policies are simulated in one pass (optional)\n");
+    printf("\t--seed <numerical_param>\tSeed of the random replacement policy (optional)\n");
+    printf("\t-L <s,E,b[,policy]>\tHierarchy mode: add a cache level (the first one is L1).\n");
+    printf("\t\t\tThe option is repeated for every level (replaces -s, -E, -b and -r)\n");
+    printf("\t--inclusion <inclusive|exclusive|nine>\tInclusion policy of the hierarchy (default nine)\n");
+    printf("\t--latency <l1,...,memory>\tLatencies of the levels and of the memory in cycles,\n");
+    printf("\t\t\tused to compute the average memory access time (optional)\n");
+    printf("\t--convert <binary_tracefile>\tConvert the trace (accesses of 1 to 64 bytes)\n");
+    printf("\t\t\tto the binary format and exit. Binary and compressed (gzip, zstd)\n");
+    printf("\t\t\ttraces are detected and read by -t\n");
+    printf("\t--generate <pattern>\tWrite a synthetic trace to the standard output (or to the\n");
+    printf("\t\t\t--convert binary trace) and exit. The pattern is sequential, strided,\n");
+    printf("\t\t\tuniform, zipf, pointer-chase or transpose\n");
+    printf("\t--accesses <numerical_param>\tNumber of generated accesses (default 1048576)\n");
+    printf("\t--footprint <numerical_param>\tBytes of memory accessed by the generated trace (default 1048576)\n");
+    printf("\t--stride <numerical_param>\tStride in bytes of the strided pattern (default 64)\n");
+    printf("\t--benchmark\tMeasure the parsing and simulation throughput of the trace for the\n");
+    printf("\t\t\t-s, -E, -b or -g geometries and the peak memory usage\n");
     printf("\t-h, --help\tPrint this help (optional)\n");
     printf("\t-v\tVerbose flag that displays trace info (optional)\n");
+    printf("\t-p\tPrint the simulation throughput in accesses per second (optional)\n");
 }
 
 /* Further the functions that print errors in case of "exceptions" are implemented */
 
-void no_argument_passed (int arg) {
+static void no_argument_passed (int arg) {
     printf("The option \"%c\" should be passed with a numerical argument\n", arg);
     exit(EXIT_SUCCESS);
 }
 
-void bad_argument_passed () {
+static void bad_argument_passed () {
     printf("A bad argument was passed\n\n");
     print_help();
     exit(EXIT_SUCCESS);    
 }
 
-void numerical_limits_exceeded () {
-    printf("The numerical values must lay in the interval [2, 255]\n");
+static void numerical_limits_exceeded (unsigned int limit) {
+    printf("The numerical values must lay in the interval [0, %u]\n", limit);
     exit(EXIT_SUCCESS);
 }
 
@@ -137,7 +637,7 @@ void numerical_limits_exceeded () {
 
 /* Functions to procees users input */
 
-void validate_string_atona (char *string_to_validate) {
+static void validate_string_atona (char *string_to_validate, unsigned int limit) {
 /*
     Function to check if the passed argument can be converted
     to a numertical representation.
@@ -167,23 +667,24 @@ void validate_string_atona (char *string_to_validate) {
          unsigned int should not be written with more than 5 symbols */
     string_len = strlen(string_to_validate);
     if (string_len > 3) {
-        numerical_limits_exceeded();
+        numerical_limits_exceeded(limit);
     }
 }
 
-void check_result_limits_atona (long unsigned int result) {
+static void check_result_limits_atona (long unsigned int result, unsigned int limit) {
 /*
     Function to check if the numerical representation of the passed
     argument does not exceed a certain limit.
 */
-    if (result > 25) {
-        numerical_limits_exceeded();
+    if (result > limit) {
+        numerical_limits_exceeded(limit);
     }
 }
 
-char atona (char *arg_to_parse) {
+static char atona_with_limit (char *arg_to_parse, unsigned int limit) {
 /*
-    Function to convert passed string arguments to their numerical representation.
+    Function to convert passed string arguments to their numerical representation,
+    which must not exceed the limit.
 */
     int string_length;
     int i;
@@ -192,7 +693,7 @@ char atona (char *arg_to_parse) {
     int current_char_numeric;
     unsigned int result_internal = 0;
     char result;
-    validate_string_atona(arg_to_parse);
+    validate_string_atona(arg_to_parse, limit);
     
     /* Convertion starts here */
     string_length = strlen(arg_to_parse);
@@ -205,12 +706,16 @@ char atona (char *arg_to_parse) {
     }
     /* Convertion ends here */
 
-    check_result_limits_atona(result_internal);
+    check_result_limits_atona(result_internal, limit);
     result = result_internal;
     return result;
 }
 
-void store_char_param (int arg, char *optarg, struct passed_args *args) {
+static char atona (char *arg_to_parse) {
+    return atona_with_limit(arg_to_parse, NUMERICAL_PARAM_MAX);
+}
+
+static void store_char_param (int arg, char *optarg, struct passed_args *args) {
 /*
     Function to store a char parameter passed to the program
 */
@@ -236,17 +741,23 @@ void store_char_param (int arg, char *optarg, struct passed_args *args) {
 
 /* Second step: we store the numerical representation of the passed argument in the
     corresponding field of the passed_args structure */
-    char parsed_arg = atona(optarg);
+    char parsed_arg = atona_with_limit(optarg, ('E' == arg) ? MAX_ASSOCIATIVITY : NUMERICAL_PARAM_MAX);
     *field_to_reference = parsed_arg;
 }
 
-void store_string_param (int arg, char *optarg, struct passed_args *args) {
+static void store_string_param (int arg, char *optarg, struct passed_args *args) {
 /* 
     Function to store a string parameter passed to the program
 */
     switch (arg) {
         case 't':
-            args->trace_file = optarg;
+            if (NULL == args->trace_file) {
+                args->trace_file = optarg;
+            }
+            args->trace_files = realloc(args->trace_files, (args->trace_files_num + 1) * sizeof(char *));
+            assert(NULL != args->trace_files);
+            args->trace_files[args->trace_files_num] = optarg;
+            args->trace_files_num++;
             break;
         default:
             printf("Default case in store_string_param. This should not have happened.\n");
@@ -255,787 +766,5516 @@ void store_string_param (int arg, char *optarg, struct passed_args *args) {
     }
 }
 
-void check_trace_file_name(char *tracefile) {
+static void store_param_range(char *range_str, char *low, char *high, unsigned int limit) {
 /*
-    A function to check that the trace file wich name was passsed as an argument
-    to the program exists and can be read
+    Function to store a numerical parameter that is either a single value
+    or a range of values "low-high"
 */
-    int result = 0;
-    result = access(tracefile, F_OK);
-    if (0 != result) {
-        printf("ERROR: File \"%s\" cannot be found\n", tracefile);
-        exit(EXIT_SUCCESS);
+    char *separator = strchr(range_str, '-');
+    if (NULL == separator) {
+        *low = atona_with_limit(range_str, limit);
+        *high = *low;
+        return;
     }
-    result = access(tracefile, R_OK);
-    if (0 != result) {
-        printf("ERROR: FILE \"%s\" exists, but cannot be read\n", tracefile);
+    /* The separator is replaced to convert both parts with atona */
+    *separator = '\0';
+    *low = atona_with_limit(range_str, limit);
+    *high = atona_with_limit(separator + 1, limit);
+    *separator = '-';
+    if (*low > *high) {
+        printf("The range \"%s\" is empty\n", range_str);
         exit(EXIT_SUCCESS);
     }
 }
 
-void validate_args (struct passed_args *args) {
+static void store_sweep_param(char *optarg, struct passed_args *args) {
 /*
-    A function to validate the arguments, passed to the program.
-    If arguments cannot be validated the execution is stopped.
+    Function to store the geometries described by a "s,E,b" sweep parameter.
+    Every combination of the values of the ranges is stored.
 */
-
-/* The following part is to check that either a help flag was set
-    or there is enough arguments to run the program normally */
-    if ((1 != args->help_flag) 
-        && ((0 == args->set_index_bits_num)
-            || (0 == args->associativity_num)
-            || (0 == args->block_bits_num)
-            || (NULL == args->trace_file))) {
-        printf("Not enough parameters are passed.\n\n");
-        print_help();
+    char *params[3];
+    char low[3];
+    char high[3];
+    char s, E, b;
+    int i;
+    params[0] = optarg;
+    for (i = 1; i < 3; i++) {
+        params[i] = strchr(params[i - 1], ',');
+        if (NULL == params[i]) {
+            printf("The sweep geometry \"%s\" should be given as \"s,E,b\"\n", optarg);
+            exit(EXIT_SUCCESS);
+        }
+        *(params[i]) = '\0';
+        params[i]++;
+    }
+    for (i = 0; i < 3; i++) {
+        store_param_range(params[i], &low[i], &high[i],
+                            (1 == i) ? MAX_ASSOCIATIVITY : NUMERICAL_PARAM_MAX);
+    }
+    if (0 == low[1]) {
+        printf("The associativity should be at least 1\n");
         exit(EXIT_SUCCESS);
     }
 
-    if (NULL != args->trace_file) {
-        check_trace_file_name(args->trace_file);
+    for (s = low[0]; s <= high[0]; s++) {
+        for (E = low[1]; E <= high[1]; E++) {
+            for (b = low[2]; b <= high[2]; b++) {
+                args->sweep_geometries = realloc(args->sweep_geometries,
+                    (args->sweep_geometries_num + 1) * sizeof(struct cache_geometry));
+                assert(NULL != args->sweep_geometries);
+                args->sweep_geometries[args->sweep_geometries_num].set_index_bits_num = s;
+                args->sweep_geometries[args->sweep_geometries_num].associativity_num = E;
+                args->sweep_geometries[args->sweep_geometries_num].block_bits_num = b;
+                args->sweep_geometries_num++;
+            }
+        }
     }
 }
 
-struct passed_args *parse_passed_arguments (int argc, char* argv[]) {
+static unsigned long atoul(char *arg_to_parse) {
 /*
-    The main function for parsing the arguments passed to the program 
+    Function to convert passed string arguments that are not limited
+    to one byte to their numerical representation.
 */
-    struct passed_args *args = malloc(sizeof(struct passed_args));
-    assert(NULL != args);
+    int i;
+    if ('\0' == arg_to_parse[0]) {
+        bad_argument_passed();
+    }
+    for (i = 0; '\0' != arg_to_parse[i]; i++) {
+        if (arg_to_parse[i] < 48 || arg_to_parse[i] > 57) {
+            printf("Some passed numerical values contain non-numeric symbols.\n");
+            printf("The program will terminate now\n");
+            exit(EXIT_SUCCESS);
+        }
+    }
+    return strtoul(arg_to_parse, NULL, 10);
+}
 
-    args->help_flag = 0;
-    args->verbose_flag = 0;
-    args->set_index_bits_num = 0;
-    args->associativity_num = 0;
-    args->block_bits_num = 0;
-    args->trace_file = NULL;
-    
-    int c;  // getopt_long stores parsed short options here
-    const char *short_opts = "hvs:E:b:t:";
-    static int help_flag;
-    opterr = 0;  // disable printing error messages by getopt_long 
-    while (1) {
-        static struct option long_options[] = 
-            {
-                {"help", no_argument, &help_flag, 1},
-                {0, 0, 0, 0}
-            };
+static int atothreads(char *arg_to_parse) {
+/*
+    Function to convert a passed number of threads, 0 is taken as 1
+*/
+    unsigned long threads_num = atoul(arg_to_parse);
+    if (threads_num > MAX_THREADS_NUM) {
+        printf("The number of threads must lay in the interval [0, %d]\n", MAX_THREADS_NUM);
+        exit(EXIT_SUCCESS);
+    }
+    return (0 == threads_num) ? 1 : threads_num;
+}
 
-        int option_index = 0;
-        c = getopt_long(argc, argv, 
-                            short_opts, long_options, &option_index);
-        
-        /* Detect the end of the options */
-        if (-1 == c) {
-            break;
+static void store_policies_param(char *optarg, struct passed_args *args) {
+/*
+    Function to store the replacement policies given as a comma-separated list
+*/
+    char *policy_name = optarg;
+    char *separator;
+    const struct replacement_policy *policy;
+    while (NULL != policy_name) {
+        separator = strchr(policy_name, ',');
+        if (NULL != separator) {
+            *separator = '\0';
         }
-        
-        switch (c) {
-            /* Case for long options */
-            case 0:
-                break;
-            
-            case 'h':
-                args->help_flag = 1;
-                break;
-            
-            case 'v':
-                args->verbose_flag = 1;
-                break;
-            
-            case 's':
-            case 'E':
-            case 'b':
-                if (NULL == optarg) no_argument_passed(c);
-                store_char_param (c, optarg, args);
-                break;
+        policy = find_replacement_policy(policy_name);
+        if (NULL == policy) {
+            printf("Unknown replacement policy \"%s\"\n\n", policy_name);
+            print_help();
+            exit(EXIT_SUCCESS);
+        }
+        args->policies = realloc(args->policies,
+                            (args->policies_num + 1) * sizeof(struct replacement_policy *));
+        assert(NULL != args->policies);
+        args->policies[args->policies_num] = policy;
+        args->policies_num++;
+        policy_name = (NULL == separator) ? NULL : separator + 1;
+    }
+}
 
-            case 't':
-                if (NULL == optarg) no_argument_passed (c);
-                store_string_param (c, optarg, args);
-                break;
+static void check_policy_geometry(const struct replacement_policy *policy, char associativity_num) {
+/*
+    Function to check that the associativity can be used with the passed policy
+*/
+    if (!is_policy_geometry_valid(policy, associativity_num)) {
+        printf("The plru policy needs the associativity to be a power of two\n");
+        exit(EXIT_SUCCESS);
+    }
+}
 
-            case '?':
-            default:
-                bad_argument_passed();
-                break;
+static void store_level_param(char *optarg, struct passed_args *args) {
+/*
+    Function to store a level of the cache hierarchy described by "s,E,b[,policy]"
+*/
+    char *params[4] = {optarg, NULL, NULL, NULL};
+    struct hierarchy_level_args *level;
+    int i;
+    for (i = 1; i < 4; i++) {
+        params[i] = strchr(params[i - 1], ',');
+        if (NULL == params[i]) {
+            break;
         }
+        *(params[i]) = '\0';
+        params[i]++;
     }
-    if (help_flag) {
-        args->help_flag = 1;
+    if (NULL == params[2]) {
+        printf("The cache level \"%s\" should be given as \"s,E,b[,policy]\"\n", optarg);
+        exit(EXIT_SUCCESS);
     }
-    
-    validate_args(args);
+
+    args->levels = realloc(args->levels, (args->levels_num + 1) * sizeof(struct hierarchy_level_args));
+    assert(NULL != args->levels);
+    level = &(args->levels[args->levels_num]);
+    args->levels_num++;
+    level->geometry.set_index_bits_num = atona(params[0]);
+    level->geometry.associativity_num = atona_with_limit(params[1], MAX_ASSOCIATIVITY);
+    level->geometry.block_bits_num = atona(params[2]);
+    if (0 == level->geometry.associativity_num) {
+        printf("The associativity should be at least 1\n");
+        exit(EXIT_SUCCESS);
+    }
+    level->policy = DEFAULT_POLICY;
+    if (NULL != params[3]) {
+        level->policy = find_replacement_policy(params[3]);
+        if (NULL == level->policy) {
+            printf("Unknown replacement policy \"%s\"\n\n", params[3]);
+            print_help();
+            exit(EXIT_SUCCESS);
+        }
+    }
+}
+
+static void store_inclusion_param(char *optarg, struct passed_args *args) {
+    args->inclusion_flag = 1;
+    if (0 == strcmp(optarg, "inclusive")) {
+        args->inclusion = INCLUSIVE;
+    } else if (0 == strcmp(optarg, "exclusive")) {
+        args->inclusion = EXCLUSIVE;
+    } else if (0 == strcmp(optarg, "nine")) {
+        args->inclusion = NINE;
+    } else {
+        bad_argument_passed();
+    }
+}
+
+static void store_latencies_param(char *optarg, struct passed_args *args) {
+/*
+    Function to store a comma-separated list of latencies
+*/
+    char *latency = optarg;
+    char *separator;
+    while (NULL != latency) {
+        separator = strchr(latency, ',');
+        if (NULL != separator) {
+            *separator = '\0';
+        }
+        args->latencies = realloc(args->latencies, (args->latencies_num + 1) * sizeof(unsigned long));
+        assert(NULL != args->latencies);
+        args->latencies[args->latencies_num] = atoul(latency);
+        args->latencies_num++;
+        latency = (NULL == separator) ? NULL : separator + 1;
+    }
+}
+
+static void store_prefetcher_param(char *optarg, struct passed_args *args) {
+    if (0 == strcmp(optarg, "next-line")) {
+        args->prefetcher_kind = NEXT_LINE_PREFETCHER;
+    } else if (0 == strcmp(optarg, "stride")) {
+        args->prefetcher_kind = STRIDE_PREFETCHER;
+    } else if (0 == strcmp(optarg, "stream")) {
+        args->prefetcher_kind = STREAM_PREFETCHER;
+    } else {
+        bad_argument_passed();
+    }
+}
+
+static void store_pattern_param(char *optarg, struct passed_args *args) {
+    if (0 == strcmp(optarg, "sequential")) {
+        args->trace_pattern = SEQUENTIAL_PATTERN;
+    } else if (0 == strcmp(optarg, "strided")) {
+        args->trace_pattern = STRIDED_PATTERN;
+    } else if (0 == strcmp(optarg, "uniform")) {
+        args->trace_pattern = UNIFORM_PATTERN;
+    } else if (0 == strcmp(optarg, "zipf")) {
+        args->trace_pattern = ZIPF_PATTERN;
+    } else if (0 == strcmp(optarg, "pointer-chase")) {
+        args->trace_pattern = POINTER_CHASE_PATTERN;
+    } else if (0 == strcmp(optarg, "transpose")) {
+        args->trace_pattern = TRANSPOSE_PATTERN;
+    } else {
+        bad_argument_passed();
+    }
+}
+
+static void store_tlb_level_param(char *optarg, struct passed_args *args) {
+/*
+    Function to store a level of the TLB described by "entries,ways"
+*/
+    struct tlb_level_args *level;
+    char *separator = strchr(optarg, ',');
+    if (NULL == separator) {
+        printf("The TLB level \"%s\" should be given as \"entries,ways\"\n", optarg);
+        exit(EXIT_SUCCESS);
+    }
+    *separator = '\0';
+    args->tlb_levels = realloc(args->tlb_levels, (args->tlb_levels_num + 1) * sizeof(struct tlb_level_args));
+    assert(NULL != args->tlb_levels);
+    level = &(args->tlb_levels[args->tlb_levels_num]);
+    args->tlb_levels_num++;
+    level->entries_num = atoul(optarg);
+    level->associativity_num = atona_with_limit(separator + 1, MAX_ASSOCIATIVITY);
+    *separator = ',';
+    if (0 == level->associativity_num || 0 == level->entries_num
+            || 0 != level->entries_num % level->associativity_num) {
+        printf("The entries of the TLB level \"%s\" should be a non zero multiple of its ways\n", optarg);
+        exit(EXIT_SUCCESS);
+    }
+}
+
+static void store_icache_param(char *optarg, struct passed_args *args) {
+/*
+    Function to store the geometry of the instruction cache described by "s,E,b"
+*/
+    char *params[3] = {optarg, NULL, NULL};
+    int i;
+    for (i = 1; i < 3; i++) {
+        params[i] = strchr(params[i - 1], ',');
+        if (NULL == params[i]) {
+            printf("The instruction cache \"%s\" should be given as \"s,E,b\"\n", optarg);
+            exit(EXIT_SUCCESS);
+        }
+        *(params[i]) = '\0';
+        params[i]++;
+    }
+    args->icache_geometry.set_index_bits_num = atona(params[0]);
+    args->icache_geometry.associativity_num = atona_with_limit(params[1], MAX_ASSOCIATIVITY);
+    args->icache_geometry.block_bits_num = atona(params[2]);
+    if (0 == args->icache_geometry.associativity_num) {
+        printf("The associativity should be at least 1\n");
+        exit(EXIT_SUCCESS);
+    }
+    args->instructions_flag = 1;
+}
+
+static void check_hierarchy_args(struct passed_args *args) {
+/*
+    Function to check that the levels of the hierarchy can be simulated together
+*/
+    struct cache_geometry upper, lower;
+    int i;
+    if (args->sweep_geometries_num > 0) {
+        printf("The sweep mode and the hierarchy mode cannot be used together\n");
+        exit(EXIT_SUCCESS);
+    }
+    /* Every level has its own geometry and policy, and the levels are simulated
+        by the main thread */
+    if (0 != args->set_index_bits_num || 0 != args->associativity_num || 0 != args->block_bits_num
+            || args->policies_num > 0 || args->threads_num > 1 || 0 != args->stack_distance_max
+            || args->reuse_curve_flag || NULL != args->convert_file) {
+        printf("The hierarchy mode takes the geometry and the policy of every level from -L,\n");
+        printf("without -s, -E, -b, -r, -j, -d, -f or --convert\n");
+        exit(EXIT_SUCCESS);
+    }
+    if (args->latencies_num > 0 && args->latencies_num != args->levels_num + 1) {
+        printf("A latency should be passed for every level and for the memory\n");
+        exit(EXIT_SUCCESS);
+    }
+    for (i = 0; i < args->levels_num; i++) {
+        check_policy_geometry(args->levels[i].policy, args->levels[i].geometry.associativity_num);
+        if (0 == i) {
+            continue;
+        }
+        upper = args->levels[i - 1].geometry;
+        lower = args->levels[i].geometry;
+        /* Exclusive levels exchange lines, so the lines must have the same size */
+        if (EXCLUSIVE == args->inclusion && upper.block_bits_num != lower.block_bits_num) {
+            printf("All levels of an exclusive hierarchy should have the same block size\n");
+            exit(EXIT_SUCCESS);
+        }
+        /* A line of an inclusive level must be inside a line of the level below */
+        if (INCLUSIVE == args->inclusion && upper.block_bits_num > lower.block_bits_num) {
+            printf("The blocks of an inclusive level cannot be bigger than the blocks below\n");
+            exit(EXIT_SUCCESS);
+        }
+    }
+}
+
+static void check_stack_distance_args(struct passed_args *args) {
+/*
+    Function to check that the stack distance modes (-d and -f) are not combined with
+    options they cannot honour: the stack distances give the results of LRU caches
+    and are computed by the main thread from a single pass over the trace
+*/
+    int i;
+    for (i = 0; i < args->policies_num; i++) {
+        if (DEFAULT_POLICY != args->policies[i]) {
+            printf("The stack distance modes simulate the lru policy only\n");
+            exit(EXIT_SUCCESS);
+        }
+    }
+    if (args->sweep_geometries_num > 0 || args->levels_num > 0 || args->threads_num > 1
+            || args->pipeline_parsers_num > 0 || NULL != args->convert_file) {
+        printf("The stack distance modes simulate the -s and -b geometry with a single thread,\n");
+        printf("without -g, -L, -j, -P or --convert\n");
+        exit(EXIT_SUCCESS);
+    }
+}
+
+static void check_trace_file_name(char *tracefile) {
+/*
+    A function to check that the trace file wich name was passsed as an argument
+    to the program exists and can be read
+*/
+    int result = 0;
+    result = access(tracefile, F_OK);
+    if (0 != result) {
+        printf("ERROR: File \"%s\" cannot be found\n", tracefile);
+        exit(EXIT_SUCCESS);
+    }
+    result = access(tracefile, R_OK);
+    if (0 != result) {
+        printf("ERROR: FILE \"%s\" exists, but cannot be read\n", tracefile);
+        exit(EXIT_SUCCESS);
+    }
+}
+
+static int is_single_geometry_mode(struct passed_args *args) {
+/*
+    Function to check if the program is run to simulate the single geometry
+    given with -s, -E and -b (i.e. no other mode was selected)
+*/
+    return (0 == args->sweep_geometries_num)
+        && (0 == args->stack_distance_max)
+        && (0 == args->reuse_curve_flag)
+        && (0 == args->levels_num)
+        && (NULL == args->convert_file);
+}
+
+static int is_serial_single_geometry_mode(struct passed_args *args) {
+/*
+    Function to check if a single cache is simulated by the main thread only
+*/
+    return is_single_geometry_mode(args) && (args->policies_num <= 1)
+        && (args->threads_num <= 1) && (0 == args->pipeline_parsers_num);
+}
+
+static void check_single_cache_mode(struct passed_args *args, const char *feature) {
+/*
+    Function to check that a feature modeled around a single cache (the -s, -E, -b one
+    with a single policy and a single trace, simulated by the main thread) is not
+    combined with a mode that simulates something else. The feature is described
+    by the beginning of the error message.
+*/
+    if (!is_serial_single_geometry_mode(args) || args->classify_flag
+            || args->trace_files_num > 1 || args->sample_rate > 1 || args->benchmark_flag) {
+        printf("%s for a single geometry with a single policy and a single trace,\n", feature);
+        printf("without -j, -P, -c, --sample or --benchmark\n");
+        exit(EXIT_SUCCESS);
+    }
+}
+
+static void validate_args (struct passed_args *args) {
+/*
+    A function to validate the arguments, passed to the program.
+    If arguments cannot be validated the execution is stopped.
+*/
+    int i, j;
+
+    /* A generated trace needs neither a geometry nor an input trace */
+    if ((1 != args->help_flag) && (NO_PATTERN != args->trace_pattern)) {
+        if ((0 == args->generated_accesses_num) || (args->generated_footprint < 64)
+                || (0 == args->generated_stride)) {
+            printf("At least one access to a footprint of at least 64 bytes with a stride of\n");
+            printf("at least 1 byte should be generated\n");
+            exit(EXIT_SUCCESS);
+        }
+        return;
+    }
+
+/* The following part is to check that either a help flag was set
+    or there is enough arguments to run the program normally */
+    if ((1 != args->help_flag) 
+        && is_single_geometry_mode(args)
+        && ((0 == args->set_index_bits_num)
+            || (0 == args->associativity_num)
+            || (0 == args->block_bits_num)
+            || (NULL == args->trace_file))) {
+        printf("Not enough parameters are passed.\n\n");
+        print_help();
+        exit(EXIT_SUCCESS);
+    }
+    if ((1 != args->help_flag) && (NULL == args->trace_file)) {
+        printf("Not enough parameters are passed.\n\n");
+        print_help();
+        exit(EXIT_SUCCESS);
+    }
+
+    for (i = 0; i < args->trace_files_num; i++) {
+        check_trace_file_name(args->trace_files[i]);
+    }
+
+    if (args->trace_files_num > MAX_CORES_NUM) {
+        printf("At most %d traces can be simulated together\n", MAX_CORES_NUM);
+        exit(EXIT_SUCCESS);
+    }
+    if (args->trace_files_num > 1
+            && (!is_serial_single_geometry_mode(args) || args->classify_flag
+                || args->write_modeling_flag || NO_PREFETCHER != args->prefetcher_kind)) {
+        printf("Several traces are simulated as the cores of a multicore system\n");
+        printf("with a single geometry and a single policy, without -j, -P, -c, writes or prefetches\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (0 != args->stack_distance_max || args->reuse_curve_flag) {
+        check_stack_distance_args(args);
+    }
+
+    if (args->levels_num > 0) {
+        check_hierarchy_args(args);
+    } else if (args->inclusion_flag || args->latencies_num > 0) {
+        printf("--inclusion and --latency describe the hierarchy of the -L levels\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (args->classify_flag && !is_serial_single_geometry_mode(args)) {
+        printf("The misses are classified for a single geometry with a single policy and without -j or -P\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (args->write_modeling_flag || NO_PREFETCHER != args->prefetcher_kind) {
+        check_single_cache_mode(args, "Writes and prefetches are modeled");
+    }
+    if (args->prefetch_params_flag && NO_PREFETCHER == args->prefetcher_kind) {
+        printf("--prefetch-degree and --prefetch-latency describe the prefetcher of --prefetch\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (args->sample_rate > 1
+            && (!is_serial_single_geometry_mode(args) || args->classify_flag || args->trace_files_num > 1
+                || args->write_modeling_flag || NO_PREFETCHER != args->prefetcher_kind)) {
+        printf("Sets are sampled for a single geometry with a single policy and a single trace,\n");
+        printf("without -j, -P, -c, writes or prefetches\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (args->victim_lines_num > 0 || args->tlb_levels_num > 0) {
+        check_single_cache_mode(args, "Victim caches and TLBs are modeled");
+    }
+    if (args->victim_lines_num > 0
+            && (args->write_modeling_flag || NO_PREFETCHER != args->prefetcher_kind)) {
+        printf("Victim caches are modeled without writes or prefetches\n");
+        exit(EXIT_SUCCESS);
+    }
+    if (args->victim_lines_num > MAX_ASSOCIATIVITY) {
+        printf("The victim cache has at most %d lines\n", MAX_ASSOCIATIVITY);
+        exit(EXIT_SUCCESS);
+    }
+    if (0 == args->page_size || 0 != (args->page_size & (args->page_size - 1))) {
+        printf("The page size should be a power of two\n");
+        exit(EXIT_SUCCESS);
+    }
+    if (args->page_size_flag && 0 == args->tlb_levels_num) {
+        printf("--page-size describes the pages translated by the --tlb levels\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (args->instructions_flag) {
+        check_single_cache_mode(args, "Instruction fetches are modeled");
+    }
+    if (args->unified_flag && 0 != args->icache_geometry.associativity_num) {
+        printf("The instruction fetches are modeled either by a separate cache or by the data cache\n");
+        exit(EXIT_SUCCESS);
+    }
+    if (!args->unified_flag && args->instructions_flag && args->policies_num > 0) {
+        check_policy_geometry(args->policies[0], args->icache_geometry.associativity_num);
+    }
+
+    if (args->window_size > 0) {
+        check_single_cache_mode(args, "Windows are written");
+    } else if (args->window_params_flag) {
+        printf("--window-format, --window-output and --window-occupancy describe\n");
+        printf("the windows of --window\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (args->benchmark_flag
+            && ((args->levels_num > 0) || (0 != args->stack_distance_max) || args->reuse_curve_flag
+                || args->policies_num > 1 || args->threads_num > 1 || args->pipeline_parsers_num > 0
+                || args->classify_flag || args->write_modeling_flag
+                || NO_PREFETCHER != args->prefetcher_kind || args->trace_files_num > 1
+                || args->sample_rate > 1 || NULL != args->convert_file)) {
+        printf("The benchmark simulates the -s, -E, -b or -g geometries of a single trace\n");
+        printf("with a single policy and no other option\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (args->pipeline_parsers_num > 0
+            && (!is_single_geometry_mode(args) || args->policies_num > 1 || args->threads_num > 1)) {
+        printf("The pipeline mode simulates a single geometry with a single policy and without -j\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    for (i = 0; i < args->policies_num; i++) {
+        if (0 == args->sweep_geometries_num) {
+            check_policy_geometry(args->policies[i], args->associativity_num);
+        }
+        for (j = 0; j < args->sweep_geometries_num; j++) {
+            check_policy_geometry(args->policies[i], args->sweep_geometries[j].associativity_num);
+        }
+    }
+}
+
+/* Value returned by getopt_long for the long options that have no short equivalent */
+# define SEED_OPTION 256
+# define INCLUSION_OPTION 257
+# define LATENCY_OPTION 258
+# define CONVERT_OPTION 259
+# define WRITE_OPTION 260
+# define NO_WRITE_ALLOCATE_OPTION 261
+# define PREFETCH_OPTION 262
+# define PREFETCH_DEGREE_OPTION 263
+# define PREFETCH_LATENCY_OPTION 264
+# define SAMPLE_OPTION 265
+# define GENERATE_OPTION 266
+# define ACCESSES_OPTION 267
+# define FOOTPRINT_OPTION 268
+# define STRIDE_OPTION 269
+# define BENCHMARK_OPTION 270
+# define WINDOW_OPTION 271
+# define WINDOW_FORMAT_OPTION 272
+# define WINDOW_OUTPUT_OPTION 273
+# define WINDOW_OCCUPANCY_OPTION 274
+# define VICTIM_OPTION 275
+# define TLB_OPTION 276
+# define PAGE_SIZE_OPTION 277
+# define ICACHE_OPTION 278
+# define UNIFIED_OPTION 279
+
+static struct passed_args *parse_passed_arguments (int argc, char* argv[]) {
+/*
+    The main function for parsing the arguments passed to the program 
+*/
+    struct passed_args *args = malloc(sizeof(struct passed_args));
+    assert(NULL != args);
+
+    args->help_flag = 0;
+    args->verbose_flag = 0;
+    args->performance_flag = 0;
+    args->set_index_bits_num = 0;
+    args->associativity_num = 0;
+    args->block_bits_num = 0;
+    args->trace_file = NULL;
+    args->trace_files = NULL;
+    args->trace_files_num = 0;
+    args->sweep_geometries = NULL;
+    args->sweep_geometries_num = 0;
+    args->threads_num = 1;
+    args->pipeline_parsers_num = 0;
+    args->stack_distance_max = 0;
+    args->reuse_curve_flag = 0;
+    args->classify_flag = 0;
+    args->write_modeling_flag = 0;
+    args->write_policy.write_back = 1;
+    args->write_policy.write_allocate = 1;
+    args->prefetcher_kind = NO_PREFETCHER;
+    args->prefetch_degree = PREFETCH_DEFAULT_DEGREE;
+    args->prefetch_latency = PREFETCH_DEFAULT_LATENCY;
+    args->prefetch_params_flag = 0;
+    args->policies = NULL;
+    args->policies_num = 0;
+    args->seed = 0;
+    args->levels = NULL;
+    args->levels_num = 0;
+    args->inclusion = NINE;
+    args->inclusion_flag = 0;
+    args->latencies = NULL;
+    args->latencies_num = 0;
+    args->convert_file = NULL;
+    args->sample_rate = 1;
+    args->trace_pattern = NO_PATTERN;
+    args->generated_accesses_num = GENERATED_DEFAULT_ACCESSES;
+    args->generated_footprint = GENERATED_DEFAULT_FOOTPRINT;
+    args->generated_stride = GENERATED_DEFAULT_STRIDE;
+    args->benchmark_flag = 0;
+    args->victim_lines_num = 0;
+    args->tlb_levels = NULL;
+    args->tlb_levels_num = 0;
+    args->page_size = PAGE_DEFAULT_SIZE;
+    args->page_size_flag = 0;
+    args->instructions_flag = 0;
+    args->unified_flag = 0;
+    args->icache_geometry.set_index_bits_num = 0;
+    args->icache_geometry.associativity_num = 0;
+    args->icache_geometry.block_bits_num = 0;
+    args->window_size = 0;
+    args->window_json_flag = 0;
+    args->window_output_file = NULL;
+    args->window_occupancy_flag = 0;
+    args->window_params_flag = 0;
+    
+    int c;  // getopt_long stores parsed short options here
+    const char *short_opts = "hvpfcs:E:b:t:g:j:P:d:r:L:";
+    static int help_flag;
+    opterr = 0;  // disable printing error messages by getopt_long 
+    while (1) {
+        static struct option long_options[] = 
+            {
+                {"help", no_argument, &help_flag, 1},
+                {"seed", required_argument, NULL, SEED_OPTION},
+                {"inclusion", required_argument, NULL, INCLUSION_OPTION},
+                {"latency", required_argument, NULL, LATENCY_OPTION},
+                {"convert", required_argument, NULL, CONVERT_OPTION},
+                {"write", required_argument, NULL, WRITE_OPTION},
+                {"no-write-allocate", no_argument, NULL, NO_WRITE_ALLOCATE_OPTION},
+                {"prefetch", required_argument, NULL, PREFETCH_OPTION},
+                {"prefetch-degree", required_argument, NULL, PREFETCH_DEGREE_OPTION},
+                {"prefetch-latency", required_argument, NULL, PREFETCH_LATENCY_OPTION},
+                {"sample", required_argument, NULL, SAMPLE_OPTION},
+                {"generate", required_argument, NULL, GENERATE_OPTION},
+                {"accesses", required_argument, NULL, ACCESSES_OPTION},
+                {"footprint", required_argument, NULL, FOOTPRINT_OPTION},
+                {"stride", required_argument, NULL, STRIDE_OPTION},
+                {"benchmark", no_argument, NULL, BENCHMARK_OPTION},
+                {"victim", required_argument, NULL, VICTIM_OPTION},
+                {"tlb", required_argument, NULL, TLB_OPTION},
+                {"page-size", required_argument, NULL, PAGE_SIZE_OPTION},
+                {"icache", required_argument, NULL, ICACHE_OPTION},
+                {"unified", no_argument, NULL, UNIFIED_OPTION},
+                {"window", required_argument, NULL, WINDOW_OPTION},
+                {"window-format", required_argument, NULL, WINDOW_FORMAT_OPTION},
+                {"window-output", required_argument, NULL, WINDOW_OUTPUT_OPTION},
+                {"window-occupancy", no_argument, NULL, WINDOW_OCCUPANCY_OPTION},
+                {0, 0, 0, 0}
+            };
+
+        int option_index = 0;
+        c = getopt_long(argc, argv, 
+                            short_opts, long_options, &option_index);
+        
+        /* Detect the end of the options */
+        if (-1 == c) {
+            break;
+        }
+        
+        switch (c) {
+            /* Case for long options */
+            case 0:
+                break;
+            
+            case 'h':
+                args->help_flag = 1;
+                break;
+            
+            case 'v':
+                args->verbose_flag = 1;
+                break;
+
+            case 'p':
+                args->performance_flag = 1;
+                break;
+            
+            case 's':
+            case 'E':
+            case 'b':
+                if (NULL == optarg) no_argument_passed(c);
+                store_char_param (c, optarg, args);
+                break;
+
+            case 't':
+                if (NULL == optarg) no_argument_passed (c);
+                store_string_param (c, optarg, args);
+                break;
+
+            case 'g':
+                if (NULL == optarg) no_argument_passed (c);
+                store_sweep_param(optarg, args);
+                break;
+
+            case 'j':
+                if (NULL == optarg) no_argument_passed (c);
+                args->threads_num = atothreads(optarg);
+                break;
+
+            case 'P':
+                if (NULL == optarg) no_argument_passed (c);
+                args->pipeline_parsers_num = atothreads(optarg);
+                break;
+
+            case 'd':
+                if (NULL == optarg) no_argument_passed (c);
+                args->stack_distance_max = atona_with_limit(optarg, MAX_ASSOCIATIVITY);
+                break;
+
+            case 'f':
+                args->reuse_curve_flag = 1;
+                break;
+
+            case 'c':
+                args->classify_flag = 1;
+                break;
+
+            case 'r':
+                if (NULL == optarg) no_argument_passed (c);
+                store_policies_param(optarg, args);
+                break;
+
+            case SEED_OPTION:
+                args->seed = atoul(optarg);
+                break;
+
+            case 'L':
+                if (NULL == optarg) no_argument_passed (c);
+                store_level_param(optarg, args);
+                break;
+
+            case INCLUSION_OPTION:
+                store_inclusion_param(optarg, args);
+                break;
+
+            case LATENCY_OPTION:
+                store_latencies_param(optarg, args);
+                break;
+
+            case CONVERT_OPTION:
+                args->convert_file = optarg;
+                break;
+
+            case WRITE_OPTION:
+                args->write_modeling_flag = 1;
+                if (0 == strcmp(optarg, "back")) {
+                    args->write_policy.write_back = 1;
+                } else if (0 == strcmp(optarg, "through")) {
+                    args->write_policy.write_back = 0;
+                } else {
+                    bad_argument_passed();
+                }
+                break;
+
+            case NO_WRITE_ALLOCATE_OPTION:
+                args->write_modeling_flag = 1;
+                args->write_policy.write_allocate = 0;
+                break;
+
+            case PREFETCH_OPTION:
+                store_prefetcher_param(optarg, args);
+                break;
+
+            case PREFETCH_DEGREE_OPTION:
+                args->prefetch_degree = atoul(optarg);
+                args->prefetch_params_flag = 1;
+                break;
+
+            case PREFETCH_LATENCY_OPTION:
+                args->prefetch_latency = atoul(optarg);
+                args->prefetch_params_flag = 1;
+                break;
+
+            case SAMPLE_OPTION:
+                args->sample_rate = atoul(optarg);
+                break;
+
+            case GENERATE_OPTION:
+                store_pattern_param(optarg, args);
+                break;
+
+            case ACCESSES_OPTION:
+                args->generated_accesses_num = atoul(optarg);
+                break;
+
+            case FOOTPRINT_OPTION:
+                args->generated_footprint = atoul(optarg);
+                break;
+
+            case STRIDE_OPTION:
+                args->generated_stride = atoul(optarg);
+                break;
+
+            case BENCHMARK_OPTION:
+                args->benchmark_flag = 1;
+                break;
+
+            case VICTIM_OPTION:
+                args->victim_lines_num = atoul(optarg);
+                break;
+
+            case TLB_OPTION:
+                store_tlb_level_param(optarg, args);
+                break;
+
+            case PAGE_SIZE_OPTION:
+                args->page_size = atoul(optarg);
+                args->page_size_flag = 1;
+                break;
+
+            case ICACHE_OPTION:
+                store_icache_param(optarg, args);
+                break;
+
+            case UNIFIED_OPTION:
+                args->instructions_flag = 1;
+                args->unified_flag = 1;
+                break;
+
+            case WINDOW_OPTION:
+                args->window_size = atoul(optarg);
+                break;
+
+            case WINDOW_FORMAT_OPTION:
+                args->window_params_flag = 1;
+                if (0 == strcmp(optarg, "csv")) {
+                    args->window_json_flag = 0;
+                } else if (0 == strcmp(optarg, "json")) {
+                    args->window_json_flag = 1;
+                } else {
+                    bad_argument_passed();
+                }
+                break;
+
+            case WINDOW_OUTPUT_OPTION:
+                args->window_output_file = optarg;
+                args->window_params_flag = 1;
+                break;
+
+            case WINDOW_OCCUPANCY_OPTION:
+                args->window_occupancy_flag = 1;
+                args->window_params_flag = 1;
+                break;
+
+            case '?':
+            default:
+                bad_argument_passed();
+                break;
+        }
+    }
+    if (help_flag) {
+        args->help_flag = 1;
+    }
+    
+    validate_args(args);
 
     return args;
 }
 
-/* END OF ARGUMENTS PARSING SECTION */
+/* END OF ARGUMENTS PARSING SECTION */
+
+
+/* PASSED ARGUMENTS HELPERS SECTION */
+
+static char get_set_bits_num(struct passed_args *args) {
+    char set_bits_num = args->set_index_bits_num;
+    return set_bits_num;
+}
+
+static char get_lines_num(struct passed_args *args) {
+    char lines_num = args->associativity_num;
+    return lines_num;
+}
+
+static char get_block_bits_num(struct passed_args *args) {
+    char block_bits_num = args->block_bits_num;
+    return block_bits_num;
+}
+
+static const struct replacement_policy *get_first_policy(struct passed_args *args) {
+    if (0 == args->policies_num) {
+        return DEFAULT_POLICY;
+    }
+    return args->policies[0];
+}
+
+static struct cache_geometry get_cache_geometry(struct passed_args *args) {
+    struct cache_geometry geometry;
+    geometry.set_index_bits_num = get_set_bits_num(args);
+    geometry.associativity_num = get_lines_num(args);
+    geometry.block_bits_num = get_block_bits_num(args);
+    return geometry;
+}
+
+/* END OF PASSED ARGUMENTS HELPERS SECTION */
+
+#endif  // CSIM_LIBRARY
+
+
+/* CACHE MODEL SECTION */
+
+static int two_to_pow(int pow) {
+/*
+    Function that returns two to the power of pow.
+    It is used for computing the number of cache sets or blocks of sets' lines.
+*/
+    int result = 1;
+    int i = 0;
+    for (i = 0; i < pow; i++) {
+        result *= 2;
+    }
+    return result;
+}
+
+static int get_number_of_sets(char set_bits_num) {
+/*
+    Function for computing the number of sets.
+*/
+    int number_of_sets = two_to_pow(set_bits_num);
+    return number_of_sets;
+}
+
+/* The following functions are used for generating the cache model */
+
+/* The arrays of the cache model are aligned on the size of a cache line
+    of the host, so the lines of a set span as few host cache lines as possible */
+# define HOST_CACHE_LINE_SIZE 64
+
+static size_t align_to_host_cache_line(size_t size) {
+    return (size + HOST_CACHE_LINE_SIZE - 1) & ~((size_t)HOST_CACHE_LINE_SIZE - 1);
+}
+
+/* The tags of sets of at least SIMD_MIN_ASSOCIATIVITY lines are compared several
+    at a time, with AVX2 instructions if the host processor supports them or
+    with SSE2 ones otherwise. The functions return the mask of the lines of the
+    set that have the passed tag, valid or not. Smaller sets are scanned line
+    by line, which stops at the first match. */
+# define SIMD_MIN_ASSOCIATIVITY 8
+
+#ifdef CSIM_X86_SIMD
+
+static unsigned long long match_tags_sse2(const unsigned long *set_tags, int number_of_lines,
+                                    unsigned long line_tag) {
+    __m128i tag = _mm_set1_epi64x(line_tag);
+    __m128i equal;
+    unsigned long long matches = 0;
+    int i;
+    for (i = 0; i + 2 <= number_of_lines; i += 2) {
+        /* SSE2 compares 32-bit halves: a tag is equal if both its halves are */
+        equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&(set_tags[i])), tag);
+        equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+        matches |= (unsigned long long)_mm_movemask_pd(_mm_castsi128_pd(equal)) << i;
+    }
+    for (; i < number_of_lines; i++) {
+        matches |= (unsigned long long)(set_tags[i] == line_tag) << i;
+    }
+    return matches;
+}
+
+__attribute__((target("avx2")))
+static unsigned long long match_tags_avx2(const unsigned long *set_tags, int number_of_lines,
+                                    unsigned long line_tag) {
+    __m256i tag = _mm256_set1_epi64x(line_tag);
+    __m256i equal;
+    unsigned long long matches = 0;
+    int i;
+    for (i = 0; i + 4 <= number_of_lines; i += 4) {
+        equal = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)&(set_tags[i])), tag);
+        matches |= (unsigned long long)_mm256_movemask_pd(_mm256_castsi256_pd(equal)) << i;
+    }
+    for (; i < number_of_lines; i++) {
+        matches |= (unsigned long long)(set_tags[i] == line_tag) << i;
+    }
+    return matches;
+}
+
+#endif
+
+static unsigned long long (*select_tag_matcher(int number_of_lines))(const unsigned long *, int, unsigned long) {
+/*
+    Function to choose how the tags of the sets are compared
+*/
+#ifdef CSIM_X86_SIMD
+    if (number_of_lines >= SIMD_MIN_ASSOCIATIVITY) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return match_tags_avx2;
+        }
+        return match_tags_sse2;
+    }
+#else
+    (void)number_of_lines;
+#endif
+    return NULL;
+}
+
+static void *allocate_model_array(size_t size) {
+/*
+    Function to allocate a zeroed array aligned on the host cache lines
+*/
+    void *array;
+    size = align_to_host_cache_line(size);
+    if (0 != posix_memalign(&array, HOST_CACHE_LINE_SIZE, size)) {
+        printf("Cannot allocate memory for the cache model\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(array, 0, size);
+    return array;
+}
+
+static struct cache_model *allocate_cache_model(int number_of_sets, int number_of_lines,
+                                        const struct replacement_policy *policy,
+                                        unsigned long seed) {
+/*
+    Function to allocate a cache model with the given number of sets
+    (that is not necessarily a power of two) and lines per set
+*/
+    struct cache_model *cache = malloc(sizeof(struct cache_model));
+    size_t lines_total = (size_t)number_of_sets * number_of_lines;
+    size_t tags_size = align_to_host_cache_line(lines_total * sizeof(unsigned long));
+    size_t valid_lines_size = align_to_host_cache_line(number_of_sets * sizeof(unsigned long long));
+    size_t line_state_size = align_to_host_cache_line(lines_total * sizeof(unsigned long));
+    size_t set_state_size = align_to_host_cache_line(number_of_sets * sizeof(unsigned long long));
+    size_t memory_size = tags_size + valid_lines_size + line_state_size + set_state_size;
+    char *memory;
+    assert(NULL != cache);
+
+    if (0 != posix_memalign((void **)&memory, HOST_CACHE_LINE_SIZE, memory_size)) {
+        printf("Cannot allocate memory for the cache model\n");
+        exit(EXIT_FAILURE);
+    }
+    /* All lines are invalid at the beginning and all policies
+        start with zero states */
+    memset(memory, 0, memory_size);
+
+    cache->number_of_sets = number_of_sets;
+    cache->number_of_lines = number_of_lines;
+    cache->tags = (unsigned long *)memory;
+    cache->match_tags = select_tag_matcher(number_of_lines);
+    cache->valid_lines = (unsigned long long *)(memory + tags_size);
+    cache->line_state = (unsigned long *)(memory + tags_size + valid_lines_size);
+    cache->set_state = (unsigned long long *)(memory + tags_size + valid_lines_size
+                                                + line_state_size);
+    cache->dirty_lines = NULL;
+    cache->prefetched_lines = NULL;
+    cache->prefetch_clock = NULL;
+    cache->policy = policy;
+    cache->seed = seed;
+    cache->clock = 0;
+    cache->statistics.hits = 0;
+    cache->statistics.misses = 0;
+    cache->statistics.evictions = 0;
+    cache->write_policy.write_back = 1;
+    cache->write_policy.write_allocate = 1;
+    cache->write_statistics.writebacks = 0;
+    cache->write_statistics.bytes_read = 0;
+    cache->write_statistics.bytes_written = 0;
+    memset(&(cache->prefetch_statistics), 0, sizeof(struct prefetch_statistics));
+    cache->line_size = 0;
+    cache->memory = memory;
+    return cache;
+}
+
+static struct cache_model *create_cache_model(struct cache_geometry geometry,
+                                        const struct replacement_policy *policy,
+                                        unsigned long seed) {
+/* Main function of the cache model section. Returns cache model, built according to the
+    user's "specifications", given as program arguments. */
+    int number_of_sets = get_number_of_sets(geometry.set_index_bits_num);
+    struct cache_model *cache = allocate_cache_model(number_of_sets, geometry.associativity_num,
+                                                        policy, seed);
+    cache->line_size = two_to_pow(geometry.block_bits_num);
+    return cache;
+}
+
+static void allocate_dirty_lines(struct cache_model *cache) {
+/*
+    Function to add the dirty bits to a cache that models the stores.
+    Most simulations do not need them, so they are not in the main block.
+*/
+    cache->dirty_lines = allocate_model_array(cache->number_of_sets * sizeof(unsigned long long));
+}
+
+static void destroy_cache_model(struct cache_model *cache) {
+    free(cache->dirty_lines);
+    free(cache->prefetched_lines);
+    free(cache->prefetch_clock);
+    free(cache->memory);
+    free(cache);
+}
+
+/* End of the subsection where the functions to generate the cache model
+    are described */
+
+/* END OF CACHE MODEL SECTION */
+
+
+#ifndef CSIM_LIBRARY
+
+/* COMPRESSED TRACES SECTION */
+
+/* Compressed traces are decompressed by a separate thread, which fills
+    a ring of DECOMPRESSED_CHUNKS_NUM chunks read by the parsing thread.
+    gzip is supported when built with CSIM_HAVE_ZLIB (link with -lz)
+    and zstd when built with CSIM_HAVE_ZSTD (link with -lzstd). */
+# define DECOMPRESSED_CHUNK_SIZE (1 << 18)
+# define DECOMPRESSED_CHUNKS_NUM 4
+
+enum TraceCompression {NO_COMPRESSION, GZIP, ZSTD};
+
+struct decompressed_chunk {
+    char data[DECOMPRESSED_CHUNK_SIZE];
+    size_t size;
+};
+
+struct decompressor {
+/*
+    Structure to store the state of the decompressing thread.
+*/
+    enum TraceCompression compression;
+    FILE *fp;
+    pthread_t thread;
+#ifdef CSIM_HAVE_ZLIB
+    gzFile gzip_file;
+#endif
+#ifdef CSIM_HAVE_ZSTD
+    ZSTD_DStream *zstd_stream;
+    ZSTD_inBuffer zstd_input;
+    char *zstd_input_data;
+#endif
+
+    struct decompressed_chunk chunks[DECOMPRESSED_CHUNKS_NUM];
+    int head;  // index of the chunk being read
+    int count;  // number of decompressed chunks that were not read yet
+    size_t head_position;  // number of bytes of the head chunk already read
+    int finished;  // set when the whole file was decompressed
+    int cancelled;  // set when the reader is closed
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+};
+
+static enum TraceCompression get_trace_compression(const unsigned char *header, size_t size) {
+/*
+    Function to detect the compression of a file by its magic bytes
+*/
+    if (size >= 2 && 0x1f == header[0] && 0x8b == header[1]) {
+        return GZIP;
+    }
+    if (size >= 4 && 0x28 == header[0] && 0xb5 == header[1]
+            && 0x2f == header[2] && 0xfd == header[3]) {
+        return ZSTD;
+    }
+    return NO_COMPRESSION;
+}
+
+static void unsupported_compression(char *file_name, const char *compression, const char *build_flag) {
+    printf("The trace %s is compressed with %s, but csim was built without %s\n",
+            file_name, compression, build_flag);
+    exit(EXIT_SUCCESS);
+}
+
+static void open_decompression_stream(struct decompressor *decompressor, char *file_name) {
+/*
+    Function to prepare the decompression of a file from its beginning
+*/
+    (void)file_name;  // used only in the errors of the builds without a library
+    fseek(decompressor->fp, 0, SEEK_SET);
+    switch (decompressor->compression) {
+        case GZIP:
+#ifdef CSIM_HAVE_ZLIB
+            /* zlib closes the descriptor it is given, the FILE keeps its own one */
+            decompressor->gzip_file = gzdopen(dup(fileno(decompressor->fp)), "rb");
+            assert(NULL != decompressor->gzip_file);
+            gzbuffer(decompressor->gzip_file, DECOMPRESSED_CHUNK_SIZE);
+#else
+            unsupported_compression(file_name, "gzip", "CSIM_HAVE_ZLIB");
+#endif
+            break;
+        case ZSTD:
+#ifdef CSIM_HAVE_ZSTD
+            decompressor->zstd_stream = ZSTD_createDStream();
+            assert(NULL != decompressor->zstd_stream);
+            ZSTD_initDStream(decompressor->zstd_stream);
+            decompressor->zstd_input_data = malloc(ZSTD_DStreamInSize());
+            assert(NULL != decompressor->zstd_input_data);
+            decompressor->zstd_input.src = decompressor->zstd_input_data;
+            decompressor->zstd_input.size = 0;
+            decompressor->zstd_input.pos = 0;
+#else
+            unsupported_compression(file_name, "zstd", "CSIM_HAVE_ZSTD");
+#endif
+            break;
+        default:
+            break;
+    }
+}
+
+static void close_decompression_stream(struct decompressor *decompressor) {
+    switch (decompressor->compression) {
+        case GZIP:
+#ifdef CSIM_HAVE_ZLIB
+            gzclose(decompressor->gzip_file);
+#endif
+            break;
+        case ZSTD:
+#ifdef CSIM_HAVE_ZSTD
+            ZSTD_freeDStream(decompressor->zstd_stream);
+            free(decompressor->zstd_input_data);
+#endif
+            break;
+        default:
+            break;
+    }
+}
+
+static size_t decompress_chunk(struct decompressor *decompressor, char *destination, size_t size) {
+/*
+    Function to decompress the next size bytes of the file (less at its end).
+    Returns the number of bytes decompressed.
+*/
+    size_t bytes_decompressed = 0;
+#ifdef CSIM_HAVE_ZLIB
+    int gzip_result;
+    int gzip_error = Z_OK;
+#endif
+#ifdef CSIM_HAVE_ZSTD
+    ZSTD_outBuffer output = {destination, size, 0};
+    size_t zstd_result;
+#endif
+    switch (decompressor->compression) {
+        case GZIP:
+#ifdef CSIM_HAVE_ZLIB
+            gzip_result = gzread(decompressor->gzip_file, destination, size);
+            /* A truncated file is only reported by gzerror */
+            if (gzip_result >= 0 && (size_t)gzip_result < size) {
+                gzerror(decompressor->gzip_file, &gzip_error);
+            }
+            if (gzip_result < 0 || (Z_OK != gzip_error && Z_STREAM_END != gzip_error)) {
+                printf("The gzip trace being parsed is corrupted.\n");
+                exit(EXIT_SUCCESS);
+            }
+            bytes_decompressed = gzip_result;
+#endif
+            break;
+        case ZSTD:
+#ifdef CSIM_HAVE_ZSTD
+            while (output.pos < output.size) {
+                if (decompressor->zstd_input.pos == decompressor->zstd_input.size) {
+                    decompressor->zstd_input.size = fread(decompressor->zstd_input_data, 1,
+                                                        ZSTD_DStreamInSize(), decompressor->fp);
+                    decompressor->zstd_input.pos = 0;
+                    if (0 == decompressor->zstd_input.size) {
+                        break;
+                    }
+                }
+                zstd_result = ZSTD_decompressStream(decompressor->zstd_stream, &output,
+                                                    &(decompressor->zstd_input));
+                if (ZSTD_isError(zstd_result)) {
+                    printf("The zstd trace being parsed is corrupted: %s.\n",
+                            ZSTD_getErrorName(zstd_result));
+                    exit(EXIT_SUCCESS);
+                }
+            }
+            bytes_decompressed = output.pos;
+#endif
+            break;
+        default:
+            break;
+    }
+    (void)destination;
+    (void)size;
+    return bytes_decompressed;
+}
+
+static void *decompressor_routine(void *decompressor_arg) {
+/*
+    Main function of the decompressing thread: fills the free chunks
+    until the file is over or the reader is closed
+*/
+    struct decompressor *decompressor = decompressor_arg;
+    struct decompressed_chunk *chunk;
+    while (1) {
+        pthread_mutex_lock(&(decompressor->mutex));
+        while (DECOMPRESSED_CHUNKS_NUM == decompressor->count && !decompressor->cancelled) {
+            pthread_cond_wait(&(decompressor->changed), &(decompressor->mutex));
+        }
+        if (decompressor->cancelled) {
+            pthread_mutex_unlock(&(decompressor->mutex));
+            break;
+        }
+        chunk = &(decompressor->chunks[(decompressor->head + decompressor->count)
+                                        % DECOMPRESSED_CHUNKS_NUM]);
+        pthread_mutex_unlock(&(decompressor->mutex));
+
+        /* The free chunk is not read by anyone, so it is filled without the lock */
+        chunk->size = decompress_chunk(decompressor, chunk->data, DECOMPRESSED_CHUNK_SIZE);
+
+        pthread_mutex_lock(&(decompressor->mutex));
+        if (0 == chunk->size) {
+            decompressor->finished = 1;
+        } else {
+            decompressor->count++;
+        }
+        pthread_cond_signal(&(decompressor->changed));
+        pthread_mutex_unlock(&(decompressor->mutex));
+        if (decompressor->finished) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static struct decompressor *start_decompressor(FILE *fp, enum TraceCompression compression, char *file_name) {
+    struct decompressor *decompressor = malloc(sizeof(struct decompressor));
+    assert(NULL != decompressor);
+    decompressor->compression = compression;
+    decompressor->fp = fp;
+    decompressor->head = 0;
+    decompressor->count = 0;
+    decompressor->head_position = 0;
+    decompressor->finished = 0;
+    decompressor->cancelled = 0;
+    open_decompression_stream(decompressor, file_name);
+    pthread_mutex_init(&(decompressor->mutex), NULL);
+    pthread_cond_init(&(decompressor->changed), NULL);
+    pthread_create(&(decompressor->thread), NULL, decompressor_routine, decompressor);
+    return decompressor;
+}
+
+static void stop_decompressor(struct decompressor *decompressor) {
+    pthread_mutex_lock(&(decompressor->mutex));
+    decompressor->cancelled = 1;
+    pthread_cond_signal(&(decompressor->changed));
+    pthread_mutex_unlock(&(decompressor->mutex));
+    pthread_join(decompressor->thread, NULL);
+    close_decompression_stream(decompressor);
+    pthread_mutex_destroy(&(decompressor->mutex));
+    pthread_cond_destroy(&(decompressor->changed));
+    free(decompressor);
+}
+
+static size_t read_decompressed(struct decompressor *decompressor, char *destination, size_t size) {
+/*
+    Function to get the next size bytes of the decompressed file (less at its end).
+    Returns the number of bytes copied.
+*/
+    struct decompressed_chunk *chunk;
+    size_t bytes_copied = 0;
+    size_t bytes_to_copy;
+    while (bytes_copied < size) {
+        pthread_mutex_lock(&(decompressor->mutex));
+        while (0 == decompressor->count && !decompressor->finished) {
+            pthread_cond_wait(&(decompressor->changed), &(decompressor->mutex));
+        }
+        if (0 == decompressor->count) {
+            pthread_mutex_unlock(&(decompressor->mutex));
+            break;
+        }
+        chunk = &(decompressor->chunks[decompressor->head]);
+        pthread_mutex_unlock(&(decompressor->mutex));
+
+        /* The head chunk is not written by the decompressing thread until it is released */
+        bytes_to_copy = chunk->size - decompressor->head_position;
+        if (bytes_to_copy > size - bytes_copied) {
+            bytes_to_copy = size - bytes_copied;
+        }
+        memcpy(destination + bytes_copied, chunk->data + decompressor->head_position, bytes_to_copy);
+        bytes_copied += bytes_to_copy;
+        decompressor->head_position += bytes_to_copy;
+
+        if (decompressor->head_position == chunk->size) {
+            pthread_mutex_lock(&(decompressor->mutex));
+            decompressor->head = (decompressor->head + 1) % DECOMPRESSED_CHUNKS_NUM;
+            decompressor->count--;
+            decompressor->head_position = 0;
+            pthread_cond_signal(&(decompressor->changed));
+            pthread_mutex_unlock(&(decompressor->mutex));
+        }
+    }
+    return bytes_copied;
+}
+
+/* END OF COMPRESSED TRACES SECTION */
+
+
+/* FILE PARSING SECTION */
+
+/* The trace file is read by chunks of this size. Lines are parsed directly
+    from the buffer, so the memory used does not depend on the trace size. */
+# define TRACE_BUFFER_SIZE (1 << 20)
+
+struct trace_reader {
+/*
+    Structure to read a trace file chunk by chunk.
+*/
+    FILE *fp;
+    struct decompressor *decompressor;  // NULL for not compressed traces
+    char *buffer;  // one extra byte is allocated to terminate the last line
+    size_t size;  // number of bytes currently stored in the buffer
+    size_t position;  // index of the first byte that was not parsed yet
+    int eof;  // set when the whole file was read into the buffer
+
+    /* Binary traces are mapped to the memory as a whole,
+        compressed ones are decoded from the buffer */
+    const unsigned char *binary_data;  // NULL for text traces
+    const unsigned char *mapped;  // NULL if the trace is not mapped
+    size_t mapped_size;
+    unsigned long previous_address;  // binary addresses are stored as deltas
+
+    int instructions_flag;  // instruction fetches are skipped if not set
+
+    /* Set filter of the sampling mode (NULL if all accesses are read): the accesses
+        to the sets whose entry is -1 are skipped as soon as their address is decoded */
+    const long *set_filter;
+    struct address_decoder filter_decoder;
+    unsigned long filtered_accesses_num;  // skipped by the filter, a modification counts as two
+};
+
+/* A binary trace starts with a header of BINARY_TRACE_HEADER_SIZE bytes:
+    the magic string (without '\0'), a version byte, the width of the addresses
+    in bits and reserved zero bytes. Every access is then stored as a byte with
+    the operation (2 low bits, I is 3) and the size minus one (6 high bits) followed
+    by the difference with the previous address, zigzag and varint encoded. The sizes
+    thus range from 1 to BINARY_TRACE_MAX_SIZE bytes, traces with other sizes are
+    not converted. */
+# define BINARY_TRACE_MAGIC "CSIMTRC"
+# define BINARY_TRACE_MAGIC_LENGTH 7
+# define BINARY_TRACE_VERSION 1
+# define BINARY_TRACE_HEADER_SIZE 16
+# define BINARY_TRACE_MAX_SIZE 64
+# define BINARY_TRACE_MAX_RECORD_SIZE 11  // operation byte and 10 bytes of a 64-bit varint
+
+static int is_binary_trace_header(const unsigned char *header, size_t size) {
+    return (size >= BINARY_TRACE_HEADER_SIZE)
+        && (0 == memcmp(header, BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC_LENGTH));
+}
+
+static void check_binary_trace_header(struct trace_reader *reader, char *file_name) {
+/*
+    Function to check the header of a binary trace and to skip it
+*/
+    const unsigned char *header = reader->binary_data;
+    reader->position = BINARY_TRACE_HEADER_SIZE;
+    reader->previous_address = 0;
+    if (BINARY_TRACE_VERSION != header[BINARY_TRACE_MAGIC_LENGTH]) {
+        printf("The binary trace %s has an unsupported version %d\n",
+                file_name, header[BINARY_TRACE_MAGIC_LENGTH]);
+        exit(EXIT_SUCCESS);
+    }
+    if (header[BINARY_TRACE_MAGIC_LENGTH + 1] > ADDRESS_BIT_LENGTH) {
+        printf("The binary trace %s uses %d-bit addresses, only %d-bit ones are supported\n",
+                file_name, header[BINARY_TRACE_MAGIC_LENGTH + 1], ADDRESS_BIT_LENGTH);
+        exit(EXIT_SUCCESS);
+    }
+}
+
+static void map_binary_trace(struct trace_reader *reader, char *file_name) {
+/*
+    Function to map the whole binary trace to the memory and to check its header
+*/
+    struct stat file_stat;
+    void *mapped;
+    if (0 != fstat(fileno(reader->fp), &file_stat)) {
+        printf("Cannot get the size of file %s\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+    mapped = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fileno(reader->fp), 0);
+    if (MAP_FAILED == mapped) {
+        printf("Cannot map file %s\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+    madvise(mapped, file_stat.st_size, MADV_SEQUENTIAL);
+    reader->mapped = mapped;
+    reader->mapped_size = file_stat.st_size;
+    reader->binary_data = reader->mapped;
+    reader->size = reader->mapped_size;
+    reader->eof = 1;
+    check_binary_trace_header(reader, file_name);
+}
+
+static size_t refill_trace_buffer(struct trace_reader *reader) {
+/*
+    Function to read the next chunk of the file. The bytes that were not
+    parsed yet (the beginning of an incomplete line) are moved to the
+    beginning of the buffer. Returns the number of bytes read.
+*/
+    size_t bytes_left = reader->size - reader->position;
+    size_t bytes_read;
+    memmove(reader->buffer, reader->buffer + reader->position, bytes_left);
+    reader->size = bytes_left;
+    reader->position = 0;
+    if (NULL != reader->decompressor) {
+        bytes_read = read_decompressed(reader->decompressor, reader->buffer + bytes_left,
+                                        TRACE_BUFFER_SIZE - bytes_left);
+    } else {
+        bytes_read = fread(reader->buffer + bytes_left, 1,
+                            TRACE_BUFFER_SIZE - bytes_left, reader->fp);
+    }
+    reader->size += bytes_read;
+    if (0 == bytes_read) {
+        reader->eof = 1;
+    }
+    return bytes_read;
+}
+
+static struct trace_reader *open_trace_reader(char *file_name) {
+/*
+    Function to open a trace file and to prepare it for reading
+*/
+    struct trace_reader *reader = malloc(sizeof(struct trace_reader));
+    enum TraceCompression compression;
+    assert(NULL != reader);
+    reader->fp = fopen(file_name, "r");
+    if (NULL == reader->fp) {
+        printf("Cannot open file %s\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+    reader->buffer = malloc(TRACE_BUFFER_SIZE + 1);
+    assert(NULL != reader->buffer);
+    reader->position = 0;
+    reader->eof = 0;
+    reader->decompressor = NULL;
+    reader->binary_data = NULL;
+    reader->mapped = NULL;
+    reader->instructions_flag = 0;
+    reader->set_filter = NULL;
+    reader->filtered_accesses_num = 0;
+    /* The beginning of the file tells if it is a compressed or a binary trace.
+        For a text trace these bytes are simply the first ones parsed. */
+    reader->size = fread(reader->buffer, 1, BINARY_TRACE_HEADER_SIZE, reader->fp);
+    compression = get_trace_compression((unsigned char *)reader->buffer, reader->size);
+    if (NO_COMPRESSION != compression) {
+        /* The decompressor starts from the beginning of the file */
+        reader->decompressor = start_decompressor(reader->fp, compression, file_name);
+        reader->size = 0;
+        refill_trace_buffer(reader);
+        if (is_binary_trace_header((unsigned char *)reader->buffer, reader->size)) {
+            reader->binary_data = (unsigned char *)reader->buffer;
+            check_binary_trace_header(reader, file_name);
+        }
+    } else if (is_binary_trace_header((unsigned char *)reader->buffer, reader->size)) {
+        map_binary_trace(reader, file_name);
+    }
+    return reader;
+}
+
+static void close_trace_reader(struct trace_reader *reader) {
+    if (NULL != reader->decompressor) {
+        stop_decompressor(reader->decompressor);
+    }
+    if (NULL != reader->mapped) {
+        munmap((void *)reader->mapped, reader->mapped_size);
+    }
+    fclose(reader->fp);
+    free(reader->buffer);
+    free(reader);
+}
+
+static char *get_next_trace_line(struct trace_reader *reader) {
+/*
+    Function to get the next line of the trace file. The line is terminated
+    with '\0' instead of '\n'. NULL is returned when the file is over.
+*/
+    char *line_start;
+    char *line_end;
+    size_t bytes_left;
+    while (1) {
+        line_start = reader->buffer + reader->position;
+        bytes_left = reader->size - reader->position;
+        line_end = memchr(line_start, '\n', bytes_left);
+        if (NULL != line_end) {
+            break;
+        }
+        if (reader->eof) {
+            /* The last line of the file may have no '\n' at its end */
+            if (0 == bytes_left) {
+                return NULL;
+            }
+            line_end = line_start + bytes_left;
+            break;
+        }
+        if (TRACE_BUFFER_SIZE == bytes_left) {
+            printf("The file being parsed contains a line longer than %d bytes.\n",
+                    TRACE_BUFFER_SIZE);
+            exit(EXIT_SUCCESS);
+        }
+        refill_trace_buffer(reader);
+    }
+    *line_end = '\0';
+    reader->position = line_end - reader->buffer;
+    if (reader->position < reader->size) {
+        reader->position++;  // skipping the '\n'
+    }
+    return line_start;
+}
+
+static enum MemoryAccessOperation get_line_operation(char operation_char) {
+/*
+    Function to return the operation with the data described on
+    a line of trace file
+*/
+    enum MemoryAccessOperation operation;
+    switch (operation_char) {
+        case 'M':
+        case 'm':
+            operation = M;
+            break;
+        case 'L':
+        case 'l':
+            operation = L;
+            break;
+        case 'S':
+        case 's':
+            operation = S;
+            break;
+        default:
+            printf("In the file being parsed an operation '%c' cannot be recognized.\n", operation_char);
+            exit(EXIT_SUCCESS);
+            break;
+    }
+    return operation;
+}
+
+/* Functions in this subsection are aimed to check the correctness of addresses
+    given in the trace file and to represent them as numerical values */
+
+static void verify_address_character(char char_to_verify) {
+/*
+    Function to check if the address given in the trace file 
+    conains only hex characters.
+*/
+    if (!(
+        (char_to_verify >= 48 && char_to_verify <= 57)  // 0..9
+        || (char_to_verify >= 65 && char_to_verify <= 70)  // A..F
+        || (char_to_verify >= 97 && char_to_verify <= 102)  // a..f
+        )) {
+        printf("The file being parsed contains an address that is not a hex value: %c\n", char_to_verify);
+        exit(EXIT_SUCCESS);
+    } 
+}
+
+static unsigned long hex_char_to_ulong(char hex_char) {
+/*
+    Function to convert a hex character to its numerical value
+*/
+    verify_address_character(hex_char);
+    if (hex_char <= 57) {
+        return hex_char - 48;
+    }
+    /* Setting the 0x20 bit turns the upper case letters into lower case ones */
+    return (hex_char | 0x20) - 87;
+}
+
+static unsigned long get_line_address(char *address_str) {
+/*
+    Function to get a numeric representation of the address
+    given on a file string
+*/
+    int i;
+    unsigned long result = 0;
+    if (' ' != address_str[0]) {
+        printf("The file being parsed is badly formatted: no space between an operation and an address ('%c' found instead).\n",
+                address_str[0]);
+        exit(EXIT_SUCCESS);
+    }
+    for (i = 1; i <= ADDRESS_BIT_LENGTH / 4; i++) {
+        if (',' == address_str[i]) {
+            break;
+        }
+        result = (result << 4) | hex_char_to_ulong(address_str[i]);
+    }
+    if (',' != address_str[i] && '\0' != address_str[i]) {
+        printf("The file being parsed contains an address longer than %d hex digits.\n",
+                ADDRESS_BIT_LENGTH / 4);
+        exit(EXIT_SUCCESS);
+    }
+    return result;
+}
+
+static unsigned int get_line_size(char *size_str) {
+/*
+    Function to get the size of the access given after the ',' of the line.
+    Accesses without a size are considered to be of 1 byte.
+*/
+    unsigned int result = 0;
+    if (NULL == size_str) {
+        return 1;
+    }
+    size_str++;
+    while (*size_str >= '0' && *size_str <= '9') {
+        result = result * 10 + (*size_str - '0');
+        size_str++;
+    }
+    return result;
+}
+
+/* End of addresses processing subsection */
+
+static int parse_trace_line(char *line, struct file_line *parsed_line, int instructions_flag) {
+/*
+    Function to parse a line of a trace file and to fill the passed
+    file_line structure with the result. Returns 0 if the line is to be
+    skipped (i.e. it describes an instruction that is not modeled).
+*/
+    if (' ' != line[0]) {
+        if (!instructions_flag || 'I' != line[0]) {
+            return 0;
+        }
+        /* Instruction lines have the same layout: "I  address,size" */
+        parsed_line->operation = I;
+    } else {
+        parsed_line->operation = get_line_operation(line[1]);
+    }
+    parsed_line->address = get_line_address(&(line[2]));
+    parsed_line->size = get_line_size(strchr(&(line[2]), ','));
+    return 1;
+}
+
+static int read_binary_access(struct trace_reader *reader, struct file_line *access) {
+/*
+    Function to decode the next access of a binary trace.
+    Returns 0 when the trace is over.
+*/
+    const unsigned char *data;
+    size_t position;
+    unsigned long long encoded_delta = 0;
+    unsigned char operation_byte;
+    unsigned char varint_byte;
+    int shift = 0;
+    if (!reader->eof && reader->size - reader->position < BINARY_TRACE_MAX_RECORD_SIZE) {
+        refill_trace_buffer(reader);
+    }
+    data = reader->binary_data;
+    position = reader->position;
+    if (position >= reader->size) {
+        return 0;
+    }
+    operation_byte = data[position++];
+    do {
+        if (position >= reader->size || shift > 63) {
+            printf("The binary trace being parsed is truncated or corrupted.\n");
+            exit(EXIT_SUCCESS);
+        }
+        varint_byte = data[position++];
+        encoded_delta |= (unsigned long long)(varint_byte & 0x7f) << shift;
+        shift += 7;
+    } while (varint_byte & 0x80);
+    reader->position = position;
+
+    /* Zigzag decoding: the lowest bit is the sign */
+    reader->previous_address += (encoded_delta >> 1) ^ -(encoded_delta & 1);
+    access->address = reader->previous_address;
+    access->size = (operation_byte >> 2) + 1;
+    access->operation = operation_byte & 3;
+    return 1;
+}
+
+static int is_filtered_access(struct trace_reader *reader, struct file_line *access) {
+/*
+    Function to check if the access is skipped by the set filter of the reader
+*/
+    unsigned long set_index = (access->address & reader->filter_decoder.set_index_mask)
+                                >> reader->filter_decoder.set_index_shift;
+    if (-1 != reader->set_filter[set_index]) {
+        return 0;
+    }
+    reader->filtered_accesses_num += (M == access->operation) ? 2 : 1;
+    return 1;
+}
+
+static int read_next_access(struct trace_reader *reader, struct file_line *access) {
+/*
+    Main fuction to process a trace file: stores the next data access
+    of the file in the passed structure. Returns 0 when the file is over.
+*/
+    char *line;
+    if (NULL != reader->binary_data) {
+        while (read_binary_access(reader, access)) {
+            /* The instruction fetches are skipped if they are not modeled */
+            if ((I != access->operation || reader->instructions_flag)
+                    && (NULL == reader->set_filter || !is_filtered_access(reader, access))) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    while (NULL != (line = get_next_trace_line(reader))) {
+        if (parse_trace_line(line, access, reader->instructions_flag)
+                && (NULL == reader->set_filter || !is_filtered_access(reader, access))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static size_t encode_binary_access(struct file_line *access, unsigned long previous_address,
+                            unsigned char *record) {
+/*
+    Function to encode an access in the binary trace format.
+    Returns the number of bytes of the record.
+*/
+    long long delta = (long long)(access->address - previous_address);
+    unsigned long long encoded_delta = ((unsigned long long)delta << 1) ^ (delta >> 63);
+    size_t record_size = 0;
+    assert(access->size >= 1 && access->size <= BINARY_TRACE_MAX_SIZE);
+    record[record_size++] = access->operation | ((access->size - 1) << 2);
+    while (encoded_delta >= 0x80) {
+        record[record_size++] = (encoded_delta & 0x7f) | 0x80;
+        encoded_delta >>= 7;
+    }
+    record[record_size++] = encoded_delta;
+    return record_size;
+}
+
+struct trace_writer {
+/*
+    Structure that represents a trace being written, in the valgrind
+    text format or in the binary format.
+*/
+    FILE *output;
+    char *file_name;
+    int binary;
+    unsigned long previous_address;  // of the last binary record
+};
+
+static struct trace_writer *open_trace_writer(char *file_name, int binary) {
+/*
+    Function to open a trace for writing. The text traces are written
+    to the standard output if file_name is NULL.
+*/
+    struct trace_writer *writer = malloc(sizeof(struct trace_writer));
+    unsigned char header[BINARY_TRACE_HEADER_SIZE];
+    assert(NULL != writer);
+    writer->file_name = (NULL != file_name) ? file_name : "<stdout>";
+    writer->output = (NULL != file_name) ? fopen(file_name, binary ? "wb" : "w") : stdout;
+    if (NULL == writer->output) {
+        printf("Cannot open file %s\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+    writer->binary = binary;
+    writer->previous_address = 0;
+    if (binary) {
+        memset(header, 0, BINARY_TRACE_HEADER_SIZE);
+        memcpy(header, BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC_LENGTH);
+        header[BINARY_TRACE_MAGIC_LENGTH] = BINARY_TRACE_VERSION;
+        header[BINARY_TRACE_MAGIC_LENGTH + 1] = ADDRESS_BIT_LENGTH;
+        fwrite(header, 1, BINARY_TRACE_HEADER_SIZE, writer->output);
+    }
+    return writer;
+}
+
+static void write_trace_access(struct trace_writer *writer, struct file_line *access) {
+    unsigned char record[BINARY_TRACE_MAX_RECORD_SIZE];
+    size_t record_size;
+    int result;
+    if (writer->binary) {
+        record_size = encode_binary_access(access, writer->previous_address, record);
+        result = (record_size == fwrite(record, 1, record_size, writer->output));
+        writer->previous_address = access->address;
+    } else {
+        result = (0 <= fprintf(writer->output, (I == access->operation) ? "%c  %lx,%u\n" : " %c %lx,%u\n",
+                                "MLSI"[access->operation], access->address, access->size));
+    }
+    if (!result) {
+        printf("Cannot write to file %s\n", writer->file_name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void close_trace_writer(struct trace_writer *writer) {
+    if (0 != ((stdout == writer->output) ? fflush(stdout) : fclose(writer->output))) {
+        printf("Cannot write to file %s\n", writer->file_name);
+        exit(EXIT_FAILURE);
+    }
+    free(writer);
+}
+
+static unsigned long convert_trace(char *input_file_name, char *output_file_name) {
+/*
+    Function to convert a trace to the binary format.
+    Returns the number of accesses converted.
+*/
+    struct trace_reader *reader = open_trace_reader(input_file_name);
+    struct trace_writer *writer = open_trace_writer(output_file_name, 1);
+    struct file_line access;
+    unsigned long accesses_count = 0;
+    /* The instruction fetches are kept, they are skipped when the binary trace is read */
+    reader->instructions_flag = 1;
+
+    while (read_next_access(reader, &access)) {
+        if (access.size < 1 || access.size > BINARY_TRACE_MAX_SIZE) {
+            printf("The access \"%c %lx,%u\" of %s cannot be converted: the accesses of\n",
+                    "MLSI"[access.operation], access.address, access.size, input_file_name);
+            printf("a binary trace have from 1 to %d bytes\n", BINARY_TRACE_MAX_SIZE);
+            exit(EXIT_SUCCESS);
+        }
+        write_trace_access(writer, &access);
+        accesses_count++;
+    }
+    close_trace_reader(reader);
+    close_trace_writer(writer);
+    return accesses_count;
+}
+
+/* END OF FILE PARSING SECTION */
+
+
+/* TRACE GENERATION SECTION */
+
+/* Synthetic traces used to measure the simulator. The accessed memory
+    (the footprint) starts at GENERATED_TRACE_BASE, the accesses are loads
+    of 8 bytes except the stores of the random patterns (one access in
+    GENERATED_STORES_PERIOD) and of the transposition. The random patterns
+    are reproducible: they depend on --seed only. */
+
+# define GENERATED_TRACE_BASE 0x10000000UL
+# define GENERATED_ACCESS_SIZE 8
+# define GENERATED_STORES_PERIOD 4
+# define GENERATED_NODE_SIZE 64  // size of the nodes of the pointer-chase pattern
+# define ZIPF_EXPONENT 0.99
+
+static unsigned long next_random(unsigned long *state) {
+/*
+    Function to get the next value of the splitmix64 generator
+*/
+    *state += 0x9E3779B97F4A7C15UL;
+    return mix_bits(*state);
+}
+
+static double next_random_fraction(unsigned long *state) {
+/*
+    Function to get a random number uniformly distributed in [0, 1)
+*/
+    return (next_random(state) >> 11) * (1.0 / (1UL << 53));
+}
+
+static double *build_zipf_distribution(unsigned long items_num) {
+/*
+    Function to get the cumulative distribution of the Zipf law over items_num ranks
+*/
+    double *distribution = malloc(items_num * sizeof(double));
+    double sum = 0;
+    unsigned long i;
+    assert(NULL != distribution);
+    for (i = 0; i < items_num; i++) {
+        sum += 1.0 / pow(i + 1, ZIPF_EXPONENT);
+        distribution[i] = sum;
+    }
+    for (i = 0; i < items_num; i++) {
+        distribution[i] /= sum;
+    }
+    return distribution;
+}
+
+static unsigned long draw_zipf_rank(double *distribution, unsigned long items_num, unsigned long *state) {
+    double fraction = next_random_fraction(state);
+    unsigned long low = 0;
+    unsigned long high = items_num - 1;
+    unsigned long middle;
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (distribution[middle] < fraction) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static unsigned long *build_pointer_chain(unsigned long nodes_num, unsigned long *state) {
+/*
+    Function to get a random cyclic permutation of the nodes (Sattolo's algorithm):
+    following it from any node visits all the nodes
+*/
+    unsigned long *next = malloc(nodes_num * sizeof(unsigned long));
+    unsigned long i, j, swap;
+    assert(NULL != next);
+    for (i = 0; i < nodes_num; i++) {
+        next[i] = i;
+    }
+    for (i = nodes_num - 1; i > 0; i--) {
+        j = next_random(state) % i;
+        swap = next[i];
+        next[i] = next[j];
+        next[j] = swap;
+    }
+    return next;
+}
+
+static unsigned long generate_trace(struct passed_args *args) {
+/*
+    Main function of the trace generation. Returns the number of accesses generated.
+*/
+    struct trace_writer *writer = open_trace_writer(args->convert_file, NULL != args->convert_file);
+    struct file_line access;
+    unsigned long footprint = args->generated_footprint;
+    unsigned long words_num = footprint / GENERATED_ACCESS_SIZE;
+    unsigned long lines_num = footprint / GENERATED_NODE_SIZE;
+    unsigned long state = args->seed;
+    unsigned long *next = NULL;
+    double *distribution = NULL;
+    unsigned long node = 0;
+    unsigned long matrix_size = sqrt(footprint / 8);  // two matrices of 4 byte elements
+    unsigned long row, column;
+    unsigned long i;
+
+    if (ZIPF_PATTERN == args->trace_pattern) {
+        distribution = build_zipf_distribution(lines_num);
+    } else if (POINTER_CHASE_PATTERN == args->trace_pattern) {
+        next = build_pointer_chain(lines_num, &state);
+    }
+    access.size = GENERATED_ACCESS_SIZE;
+    for (i = 0; i < args->generated_accesses_num; i++) {
+        access.operation = L;
+        switch (args->trace_pattern) {
+            case SEQUENTIAL_PATTERN:
+                access.address = (i * GENERATED_ACCESS_SIZE) % footprint;
+                break;
+            case STRIDED_PATTERN:
+                access.address = (i * args->generated_stride) % footprint;
+                break;
+            case UNIFORM_PATTERN:
+                access.address = (next_random(&state) % words_num) * GENERATED_ACCESS_SIZE;
+                break;
+            case ZIPF_PATTERN:
+                /* The ranks are spread over the lines (2654435761 is prime) */
+                access.address = (draw_zipf_rank(distribution, lines_num, &state) * 2654435761UL
+                                    % lines_num) * GENERATED_NODE_SIZE
+                                + (next_random(&state) % (GENERATED_NODE_SIZE / GENERATED_ACCESS_SIZE))
+                                    * GENERATED_ACCESS_SIZE;
+                break;
+            case POINTER_CHASE_PATTERN:
+                access.address = node * GENERATED_NODE_SIZE;
+                node = next[node];
+                break;
+            case TRANSPOSE_PATTERN:
+                /* B[column][row] = A[row][column], element after element */
+                row = (i / 2) / matrix_size % matrix_size;
+                column = (i / 2) % matrix_size;
+                access.size = 4;
+                if (0 == i % 2) {
+                    access.address = (row * matrix_size + column) * 4;
+                } else {
+                    access.operation = S;
+                    access.address = matrix_size * matrix_size * 4 + (column * matrix_size + row) * 4;
+                }
+                break;
+            default:
+                break;
+        }
+        if ((UNIFORM_PATTERN == args->trace_pattern || ZIPF_PATTERN == args->trace_pattern)
+                && (0 == next_random(&state) % GENERATED_STORES_PERIOD)) {
+            access.operation = S;
+        }
+        access.address += GENERATED_TRACE_BASE;
+        write_trace_access(writer, &access);
+    }
+    close_trace_writer(writer);
+    free(distribution);
+    free(next);
+    return args->generated_accesses_num;
+}
+
+/* END OF TRACE GENERATION SECTION */
+
+#endif  // CSIM_LIBRARY
+
+
+/* ADDRESS COMPUTING SECTION */
+
+static unsigned long generate_addr_mask(int left_offset, int right_offset) {
+/* 
+    Function for mask generation. 
+    left_offset - number of zero most significant bits in the mask.
+    right_offset - number of zero least significant bits in the mask. 
+*/
+    unsigned long right_mask = 1;
+    unsigned long mask = 1;
+    
+    /* Several checkings of variable boundaries.  */
+    if (left_offset >= ADDRESS_BIT_LENGTH) {
+        mask = 0;  // all 1's 
+        return mask;
+    }
+    if (left_offset <= 0) {
+        left_offset = 0;
+        mask = ~0UL;
+    }
+    if (right_offset >= ADDRESS_BIT_LENGTH) {
+        mask = 0;
+        return mask;
+    }
+    if (right_offset < 0) {
+        right_offset = 0;
+    }
+    
+    /* Case when the mask offsets overlap */
+    if (right_offset > (ADDRESS_BIT_LENGTH - left_offset)) return 0;
+
+    right_mask = (right_mask << right_offset) - 1;
+    /* Generating mask without considering the right offset */
+    if (left_offset != 0) {
+        mask = (mask << (ADDRESS_BIT_LENGTH - left_offset)) - 1;
+    }
+    /* Now we consider the right offset */
+    mask = mask - right_mask;
+    return mask;
+}
+
+static unsigned long generate_set_index_mask(struct cache_geometry geometry) {
+/* 
+    Generate mask for set index extraction.
+*/
+    char set_bits_num = geometry.set_index_bits_num;
+    char block_bits_num = geometry.block_bits_num;
+    char tag_bits_num = ADDRESS_BIT_LENGTH - set_bits_num - block_bits_num;
+    unsigned long mask = generate_addr_mask(tag_bits_num, block_bits_num);
+    return mask;
+}
+
+static unsigned long generate_block_offset_mask(struct cache_geometry geometry) {
+/*
+    Generate mask for block offset value extraction.
+*/
+    char block_bits_num = geometry.block_bits_num;
+    char left_offset_mask = ADDRESS_BIT_LENGTH - block_bits_num;
+    unsigned long mask = generate_addr_mask(left_offset_mask, 0);
+    return mask;
+}
+
+static unsigned long generate_tag_mask(struct cache_geometry geometry) {
+/*
+    Generate mask for line tag extraction.
+*/
+    char set_bits_num = geometry.set_index_bits_num;
+    char block_bits_num = geometry.block_bits_num;
+    unsigned long mask = generate_addr_mask(0, set_bits_num + block_bits_num);
+    return mask;
+}
+
+static struct address_decoder create_address_decoder(struct cache_geometry geometry) {
+/*
+    Function to compute the masks and the shifts needed to separate addresses
+*/
+    struct address_decoder decoder;
+    decoder.set_index_mask = generate_set_index_mask(geometry);
+    decoder.line_tag_mask = generate_tag_mask(geometry);
+    decoder.block_offset_mask = generate_block_offset_mask(geometry);
+    decoder.set_index_shift = geometry.block_bits_num;
+    decoder.line_tag_shift = geometry.block_bits_num + geometry.set_index_bits_num;
+    return decoder;
+}
+
+static long get_set_index(unsigned long address, struct address_decoder decoder) {
+/*
+    A function to extract the set index from an address
+*/
+    return (address & decoder.set_index_mask) >> decoder.set_index_shift;
+}
+
+static long get_line_tag(unsigned long address, struct address_decoder decoder) {
+/*
+    A function to extract the line tag from an address
+*/
+    return (address & decoder.line_tag_mask) >> decoder.line_tag_shift;
+}
+
+static long get_offset(unsigned long address, struct address_decoder decoder) {
+/*
+    A function to extract the block offset from an address
+*/
+    return address & decoder.block_offset_mask;
+}
+
+#ifndef CSIM_LIBRARY  // used by the victim cache and the hierarchy only
+
+static unsigned long join_address(long set_index, long line_tag, struct address_decoder decoder) {
+/*
+    A function to compute the address of the first byte of a line from its set index and tag
+*/
+    return ((unsigned long)line_tag << decoder.line_tag_shift)
+            | ((unsigned long)set_index << decoder.set_index_shift);
+}
+
+#endif  // CSIM_LIBRARY
+
+static struct address_separated separate_address(unsigned long address, struct address_decoder decoder) {
+/*
+    A function to separate an address into a set index, line tag and block offset parts
+*/
+    struct address_separated separated_address;
+    separated_address.set_index = get_set_index(address, decoder);
+    separated_address.line_tag = get_line_tag(address, decoder);
+    separated_address.block_offset = get_offset(address, decoder);
+    return separated_address;
+}
+
+/* END OF ADDRESS COMPUTING SECTION */
+
+
+/* CACHE MANIPULATION SECTION  */
+
+static int get_free_line(struct cache_model *cache, long set_index) {
+/*
+    Function to find a line of the set that is not storing any cache data
+    and, therfore, can be used to store some. Returns -1 if the set is full.
+*/
+    unsigned long long free_lines = ~(cache->valid_lines[set_index]);
+    if (cache->number_of_lines < 64) {
+        free_lines &= (1ULL << cache->number_of_lines) - 1;
+    }
+    if (0 == free_lines) {
+        return -1;
+    }
+    return __builtin_ctzll(free_lines);
+}
+
+static int add_to_set(struct cache_model *cache, long set_index, long line_tag,
+                unsigned long *evicted_tag) {
+/*
+    Function that stimulates the process of adding data with the passed tag
+    to a passed set of the cache. Returns 1 if another line was evicted
+    (its tag is stored at evicted_tag), 0 otherwise. Evictions are counted
+    by the callers, as prefetches are not counted with the demand accesses.
+*/
+    int line_index = get_free_line(cache, set_index);
+    int evicted = 0;
+    long position;
+    if (-1 == line_index) {
+        /* If we are here no usable line was found.
+        The replacement policy chooses the line to evict. */
+        line_index = cache->policy->choose_victim(cache, set_index, line_tag);
+        *evicted_tag = cache->tags[set_index * cache->number_of_lines + line_index];
+        evicted = 1;
+        if (NULL != cache->dirty_lines && (cache->dirty_lines[set_index] & (1ULL << line_index))) {
+            cache->write_statistics.writebacks += 1;
+            cache->write_statistics.bytes_written += cache->line_size;
+        }
+        if (NULL != cache->prefetched_lines
+                && (cache->prefetched_lines[set_index] & (1ULL << line_index))) {
+            cache->prefetch_statistics.polluting += 1;
+        }
+    }
+    position = set_index * cache->number_of_lines + line_index;
+    cache->tags[position] = line_tag;
+    cache->valid_lines[set_index] |= 1ULL << line_index;
+    if (NULL != cache->dirty_lines) {
+        cache->dirty_lines[set_index] &= ~(1ULL << line_index);
+    }
+    if (NULL != cache->prefetched_lines) {
+        cache->prefetched_lines[set_index] &= ~(1ULL << line_index);
+    }
+    cache->write_statistics.bytes_read += cache->line_size;
+    cache->policy->on_fill(cache, set_index, line_index);
+    return evicted;
+}
+
+static int find_line(struct cache_model *cache, long set_index, long line_tag) {
+/*
+    Function to find the valid line of the set with the passed tag.
+    Returns -1 if there is no such line.
+*/
+    int number_of_lines = cache->number_of_lines;
+    unsigned long *set_tags = &(cache->tags[set_index * number_of_lines]);
+    unsigned long long valid_lines = cache->valid_lines[set_index];
+    unsigned long long matches;
+    int i;
+    if (NULL != cache->match_tags) {
+        matches = cache->match_tags(set_tags, number_of_lines, line_tag) & valid_lines;
+        return (0 == matches) ? -1 : __builtin_ctzll(matches);
+    }
+    for (i = 0; i < number_of_lines; i++) {
+        if ((valid_lines & (1ULL << i)) && set_tags[i] == (unsigned long)line_tag) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#ifndef CSIM_LIBRARY  // used by the victim cache, the hierarchy and the multicore mode only
+
+static int invalidate_line(struct cache_model *cache, long set_index, long line_tag) {
+/*
+    Function to remove the line with the passed tag from the set.
+    Returns 1 if the line was in the set.
+*/
+    int line_index = find_line(cache, set_index, line_tag);
+    if (-1 == line_index) {
+        return 0;
+    }
+    cache->valid_lines[set_index] &= ~(1ULL << line_index);
+    if (NULL != cache->dirty_lines) {
+        cache->dirty_lines[set_index] &= ~(1ULL << line_index);
+    }
+    if (NULL != cache->prefetched_lines) {
+        cache->prefetched_lines[set_index] &= ~(1ULL << line_index);
+    }
+    return 1;
+}
+
+#endif  // CSIM_LIBRARY
+
+static int check_validity(struct cache_model *cache, long set_index, long line_tag) {
+/*
+    Function to check if the data stored at the given address is in the cache
+    (interal)
+*/
+    int found_line_index = find_line(cache, set_index, line_tag);
+    if (-1 == found_line_index) {
+        return 0;
+    }
+    /* The replacement policy updates the state of the cache entry here */
+    cache->policy->on_hit(cache, set_index, found_line_index);
+    return 1;
+}
+
+/* Accesses to caches of the most common associativities are simulated by
+    kernels where the number of lines is a constant, so the comparison of
+    the tags is unrolled and has no early exit (the vector comparison is kept
+    for the sets that have one). A direct mapped cache does not
+    need its replacement policy at all: its only line is always the victim. */
+
+static void simulate_direct_mapped_access(struct cache_model *cache, long set_index, long line_tag) {
+    unsigned long long valid_line = cache->valid_lines[set_index] & 1;
+    cache->clock += 1;
+    if (valid_line && cache->tags[set_index] == (unsigned long)line_tag) {
+        cache->statistics.hits += 1;
+        return;
+    }
+    cache->statistics.misses += 1;
+    if (valid_line) {
+        cache->statistics.evictions += 1;
+        if (NULL != cache->dirty_lines && (cache->dirty_lines[set_index] & 1)) {
+            cache->write_statistics.writebacks += 1;
+            cache->write_statistics.bytes_written += cache->line_size;
+        }
+        if (NULL != cache->prefetched_lines && (cache->prefetched_lines[set_index] & 1)) {
+            cache->prefetch_statistics.polluting += 1;
+        }
+    }
+    cache->tags[set_index] = line_tag;
+    cache->valid_lines[set_index] = 1;
+    if (NULL != cache->dirty_lines) {
+        cache->dirty_lines[set_index] = 0;
+    }
+    if (NULL != cache->prefetched_lines) {
+        cache->prefetched_lines[set_index] = 0;
+    }
+    cache->write_statistics.bytes_read += cache->line_size;
+}
+
+# define DEFINE_SET_ACCESS_KERNEL(WAYS) \
+static void simulate_access_##WAYS##_ways(struct cache_model *cache, long set_index, long line_tag) { \
+    unsigned long *set_tags = &(cache->tags[set_index * WAYS]); \
+    unsigned long long matches = 0; \
+    unsigned long evicted_tag; \
+    int i; \
+    cache->clock += 1; \
+    if (NULL != cache->match_tags) { \
+        matches = cache->match_tags(set_tags, WAYS, line_tag); \
+    } else { \
+        for (i = 0; i < WAYS; i++) { \
+            matches |= (unsigned long long)(set_tags[i] == (unsigned long)line_tag) << i; \
+        } \
+    } \
+    matches &= cache->valid_lines[set_index]; \
+    if (0 != matches) { \
+        cache->statistics.hits += 1; \
+        cache->policy->on_hit(cache, set_index, __builtin_ctzll(matches)); \
+        return; \
+    } \
+    cache->statistics.misses += 1; \
+    if (add_to_set(cache, set_index, line_tag, &evicted_tag)) { \
+        cache->statistics.evictions += 1; \
+    } \
+}
+
+DEFINE_SET_ACCESS_KERNEL(2)
+DEFINE_SET_ACCESS_KERNEL(4)
+DEFINE_SET_ACCESS_KERNEL(8)
+DEFINE_SET_ACCESS_KERNEL(16)
+
+static void simulate_access(struct cache_model *cache, long set_index, long line_tag) {
+/*
+    Function to simulate an access to the line with the passed tag in the passed set
+*/
+    unsigned long evicted_tag;
+    switch (cache->number_of_lines) {
+        case 1:
+            simulate_direct_mapped_access(cache, set_index, line_tag);
+            return;
+        case 2:
+            simulate_access_2_ways(cache, set_index, line_tag);
+            return;
+        case 4:
+            simulate_access_4_ways(cache, set_index, line_tag);
+            return;
+        case 8:
+            simulate_access_8_ways(cache, set_index, line_tag);
+            return;
+        case 16:
+            simulate_access_16_ways(cache, set_index, line_tag);
+            return;
+        default:
+            break;
+    }
+    /* Only the accessed line gets the new clock value, so the other
+        sets are not touched at all */
+    cache->clock += 1;
+    if (check_validity(cache, set_index, line_tag)) {
+        cache->statistics.hits += 1;
+        return;
+    }
+    cache->statistics.misses += 1;
+    if (add_to_set(cache, set_index, line_tag, &evicted_tag)) {
+        cache->statistics.evictions += 1;
+    }
+}
+
+static void simulate_write(struct cache_model *cache, long set_index, long line_tag, unsigned int size) {
+/*
+    Function to simulate a store of size bytes to the line with the passed tag
+    in the passed set, according to the write policy of the cache
+*/
+    unsigned long evicted_tag;
+    int line_index;
+    cache->clock += 1;
+    line_index = find_line(cache, set_index, line_tag);
+    if (-1 != line_index) {
+        cache->statistics.hits += 1;
+        cache->policy->on_hit(cache, set_index, line_index);
+    } else {
+        cache->statistics.misses += 1;
+        if (!cache->write_policy.write_allocate) {
+            cache->write_statistics.bytes_written += size;
+            return;
+        }
+        if (add_to_set(cache, set_index, line_tag, &evicted_tag)) {
+            cache->statistics.evictions += 1;
+        }
+        line_index = find_line(cache, set_index, line_tag);
+    }
+    if (cache->write_policy.write_back) {
+        cache->dirty_lines[set_index] |= 1ULL << line_index;
+    } else {
+        cache->write_statistics.bytes_written += size;
+    }
+}
+
+static int make_cache_operation_step(struct file_line *access, struct cache_model *cache,
+                                struct address_decoder decoder) {
+/*
+    Function to process a line of the trace file according to its operation:
+    a load reads, a store writes and a modification reads and then writes.
+    Returns the number of accesses simulated.
+*/
+    struct address_separated addr_sep = separate_address(access->address, decoder);
+    if (S != access->operation) {
+        simulate_access(cache, addr_sep.set_index, addr_sep.line_tag);
+    }
+    if (L != access->operation) {
+        simulate_write(cache, addr_sep.set_index, addr_sep.line_tag, access->size);
+    }
+    return (M == access->operation) ? 2 : 1;
+}
+
+static void make_cache_step(unsigned long address, struct cache_model *cache,
+                        struct address_decoder decoder) {
+/*
+    A main function to process the lines of the trace file in a sequential way
+*/
+    struct address_separated addr_sep = separate_address(address, decoder);
+    simulate_access(cache, addr_sep.set_index, addr_sep.line_tag);
+}
+
+/* END OF CACHE MANIPULATION SECTION  */
+
+
+#ifndef CSIM_LIBRARY
+
+/* PREFETCHING SECTION */
+
+/* Prefetchers watch the demand accesses (by line addresses) and fill the lines
+    they predict into the cache:
+    - next-line prefetches the lines following a missed line or a line used
+        for the first time after being prefetched;
+    - stride keeps the last address and the stride of every region of memory
+        in a small table and prefetches along a stride seen twice in a row;
+    - stream tracks the misses moving in the same direction in a window of
+        lines and prefetches ahead of the confirmed streams.
+    A prefetch takes prefetch_latency accesses to complete, a demand access
+    to the line before that is a late prefetch and counts as a demand miss. */
+
+# define STRIDE_TABLE_SIZE 64  // power of two
+# define STRIDE_REGION_BITS 12  // a table entry follows a 4 KB region
+# define STREAM_TRACKERS_NUM 16
+# define STREAM_WINDOW_LINES 16
+
+static void allocate_prefetch_state(struct cache_model *cache) {
+/*
+    Function to add the prefetched bits and the prefetch clocks of the lines
+    to a cache modeled with a prefetcher
+*/
+    cache->prefetched_lines = allocate_model_array(cache->number_of_sets
+                                                    * sizeof(unsigned long long));
+    cache->prefetch_clock = allocate_model_array((size_t)cache->number_of_sets
+                                                    * cache->number_of_lines * sizeof(unsigned long));
+}
+
+static int prefetch_line(struct cache_model *cache, long set_index, long line_tag) {
+/*
+    Function to bring a line in the cache without a demand access.
+    Returns 1 if the line was not in the cache.
+*/
+    unsigned long evicted_tag;
+    int line_index;
+    if (-1 != find_line(cache, set_index, line_tag)) {
+        return 0;
+    }
+    add_to_set(cache, set_index, line_tag, &evicted_tag);
+    line_index = find_line(cache, set_index, line_tag);
+    cache->prefetched_lines[set_index] |= 1ULL << line_index;
+    cache->prefetch_clock[set_index * cache->number_of_lines + line_index] = cache->clock;
+    cache->prefetch_statistics.issued += 1;
+    return 1;
+}
+
+static int use_prefetched_line(struct cache_model *cache, long set_index, long line_tag,
+                        unsigned long prefetch_latency) {
+/*
+    Function to account for a demand access to a prefetched line that was
+    not used yet. Returns 1 if the line was such a line. The line is valid
+    since the prefetch was issued, so a late prefetch was counted as a hit:
+    it is counted as a miss instead, as the access waits for the line.
+*/
+    int line_index = find_line(cache, set_index, line_tag);
+    if (-1 == line_index || !(cache->prefetched_lines[set_index] & (1ULL << line_index))) {
+        return 0;
+    }
+    cache->prefetched_lines[set_index] &= ~(1ULL << line_index);
+    cache->prefetch_statistics.useful += 1;
+    if (cache->clock - cache->prefetch_clock[set_index * cache->number_of_lines + line_index]
+            < prefetch_latency) {
+        cache->prefetch_statistics.late += 1;
+        cache->statistics.hits -= 1;
+        cache->statistics.misses += 1;
+    }
+    return 1;
+}
+
+struct stride_entry {
+    unsigned long region;
+    unsigned long last_address;
+    long stride;
+    int confirmed;  // the stride was seen twice in a row
+};
+
+struct stream_tracker {
+    unsigned long last_line;
+    int direction;  // 1 or -1
+    int confidence;
+    unsigned long last_use;  // for the replacement of the trackers
+};
+
+struct prefetcher {
+/*
+    Structure to store the state of a prefetcher.
+*/
+    enum PrefetcherKind kind;
+    unsigned long degree;  // number of lines prefetched at once
+    unsigned long latency;  // in accesses
+    struct stride_entry stride_table[STRIDE_TABLE_SIZE];
+    struct stream_tracker stream_trackers[STREAM_TRACKERS_NUM];
+    unsigned long misses_num;  // used as the clock of the stream trackers
+};
+
+static struct prefetcher *create_prefetcher(enum PrefetcherKind kind, unsigned long degree,
+                                        unsigned long latency) {
+    struct prefetcher *prefetcher = calloc(1, sizeof(struct prefetcher));
+    assert(NULL != prefetcher);
+    prefetcher->kind = kind;
+    prefetcher->degree = degree;
+    prefetcher->latency = latency;
+    return prefetcher;
+}
+
+static void prefetch_line_address(struct cache_model *cache, struct address_decoder decoder,
+                            unsigned long line_address) {
+    struct address_separated addr_sep = separate_address(line_address << decoder.set_index_shift,
+                                                            decoder);
+    prefetch_line(cache, addr_sep.set_index, addr_sep.line_tag);
+}
+
+static void prefetch_next_lines(struct prefetcher *prefetcher, struct cache_model *cache,
+                            struct address_decoder decoder, unsigned long line_address,
+                            long step) {
+/*
+    Function to prefetch degree lines from line_address going by step lines
+*/
+    unsigned long i;
+    for (i = 1; i <= prefetcher->degree; i++) {
+        prefetch_line_address(cache, decoder, line_address + i * step);
+    }
+}
+
+static void train_stride_prefetcher(struct prefetcher *prefetcher, struct cache_model *cache,
+                                struct address_decoder decoder, unsigned long address) {
+    unsigned long region = address >> STRIDE_REGION_BITS;
+    struct stride_entry *entry = &(prefetcher->stride_table[mix_bits(region)
+                                                            & (STRIDE_TABLE_SIZE - 1)]);
+    long stride;
+    unsigned long i;
+    if (entry->region != region) {
+        entry->region = region;
+        entry->last_address = address;
+        entry->stride = 0;
+        entry->confirmed = 0;
+        return;
+    }
+    stride = address - entry->last_address;
+    entry->confirmed = (0 != stride && stride == entry->stride);
+    entry->stride = stride;
+    entry->last_address = address;
+    if (!entry->confirmed) {
+        return;
+    }
+    for (i = 1; i <= prefetcher->degree; i++) {
+        prefetch_line_address(cache, decoder,
+                                (address + i * stride) >> decoder.set_index_shift);
+    }
+}
+
+static void train_stream_prefetcher(struct prefetcher *prefetcher, struct cache_model *cache,
+                                struct address_decoder decoder, unsigned long line_address) {
+/*
+    Function to update the stream trackers with a missed line
+*/
+    struct stream_tracker *tracker = NULL;
+    struct stream_tracker *oldest = &(prefetcher->stream_trackers[0]);
+    long distance;
+    int direction;
+    int i;
+    prefetcher->misses_num++;
+    for (i = 0; i < STREAM_TRACKERS_NUM; i++) {
+        distance = line_address - prefetcher->stream_trackers[i].last_line;
+        if (0 != prefetcher->stream_trackers[i].last_use
+                && distance != 0 && labs(distance) <= STREAM_WINDOW_LINES) {
+            tracker = &(prefetcher->stream_trackers[i]);
+            break;
+        }
+        if (prefetcher->stream_trackers[i].last_use < oldest->last_use) {
+            oldest = &(prefetcher->stream_trackers[i]);
+        }
+    }
+    if (NULL == tracker) {
+        oldest->last_line = line_address;
+        oldest->direction = 1;
+        oldest->confidence = 0;
+        oldest->last_use = prefetcher->misses_num;
+        return;
+    }
+    direction = (line_address > tracker->last_line) ? 1 : -1;
+    if (direction == tracker->direction) {
+        tracker->confidence++;
+    } else {
+        tracker->direction = direction;
+        tracker->confidence = 1;
+    }
+    tracker->last_line = line_address;
+    tracker->last_use = prefetcher->misses_num;
+    if (tracker->confidence >= 2) {
+        prefetch_next_lines(prefetcher, cache, decoder, line_address, direction);
+    }
+}
+
+static void make_prefetch_step(struct prefetcher *prefetcher, struct cache_model *cache,
+                        struct address_decoder decoder, unsigned long address, int demand_miss) {
+/*
+    Function to train the prefetcher with a demand access that was just simulated
+    and to issue the prefetches it predicts
+*/
+    struct address_separated addr_sep = separate_address(address, decoder);
+    unsigned long line_address = address >> decoder.set_index_shift;
+    int prefetch_hit = !demand_miss
+        && use_prefetched_line(cache, addr_sep.set_index, addr_sep.line_tag, prefetcher->latency);
+    switch (prefetcher->kind) {
+        case NEXT_LINE_PREFETCHER:
+            if (demand_miss || prefetch_hit) {
+                prefetch_next_lines(prefetcher, cache, decoder, line_address, 1);
+            }
+            break;
+        case STRIDE_PREFETCHER:
+            train_stride_prefetcher(prefetcher, cache, decoder, address);
+            break;
+        case STREAM_PREFETCHER:
+            /* A hit on a prefetched line would have been a miss without the prefetcher */
+            if (demand_miss || prefetch_hit) {
+                train_stream_prefetcher(prefetcher, cache, decoder, line_address);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void print_prefetch_statistics(struct cache_model *cache) {
+    printf("prefetches:%lu useful:%lu late:%lu polluting:%lu\n",
+            cache->prefetch_statistics.issued, cache->prefetch_statistics.useful,
+            cache->prefetch_statistics.late, cache->prefetch_statistics.polluting);
+}
+
+/* END OF PREFETCHING SECTION */
+
+
+/* VICTIM CACHE AND TLB SECTION */
+
+/* The victim cache is a fully associative LRU cache_model with one set, whose tags
+    are line addresses. It receives the lines evicted from the cache and is looked
+    up on the misses of the cache: on a hit the line is swapped with the one the
+    cache evicts. The accesses of the cache are counted as usual, the victim cache
+    counts how many of its misses it served. */
+
+static struct cache_model *create_victim_cache(unsigned long lines_num) {
+    return allocate_cache_model(1, lines_num, DEFAULT_POLICY, 0);
+}
+
+static void make_victim_cache_step(unsigned long address, struct cache_model *cache,
+                            struct cache_model *victim, struct address_decoder decoder) {
+/*
+    Function to simulate an access to the cache backed by the victim cache
+*/
+    struct address_separated addr_sep = separate_address(address, decoder);
+    unsigned long line_address = address >> decoder.set_index_shift;
+    unsigned long evicted_tag;
+    unsigned long dropped_line;
+    cache->clock += 1;
+    if (check_validity(cache, addr_sep.set_index, addr_sep.line_tag)) {
+        cache->statistics.hits += 1;
+        return;
+    }
+    cache->statistics.misses += 1;
+    victim->clock += 1;
+    if (invalidate_line(victim, 0, line_address)) {
+        victim->statistics.hits += 1;
+    } else {
+        victim->statistics.misses += 1;
+    }
+    if (add_to_set(cache, addr_sep.set_index, addr_sep.line_tag, &evicted_tag)) {
+        cache->statistics.evictions += 1;
+        if (add_to_set(victim, 0, join_address(addr_sep.set_index, evicted_tag, decoder)
+                                    >> decoder.set_index_shift, &dropped_line)) {
+            victim->statistics.evictions += 1;
+        }
+    }
+}
+
+/* Every TLB level is an LRU cache_model whose lines are page translations:
+    the set of a page is its number modulo the number of sets, so the number
+    of entries need not be a power of two. An access looks up the levels from
+    L1 and fills every level that missed; a miss of the last level is a page walk. */
+
+struct tlb {
+/*
+    Structure that represents the levels of a TLB.
+*/
+    struct cache_model **levels;
+    int levels_num;
+    int page_bits_num;
+    unsigned long page_walks;
+};
+
+static struct tlb *create_tlb(struct passed_args *args) {
+    struct tlb *tlb = malloc(sizeof(struct tlb));
+    int i;
+    assert(NULL != tlb);
+    tlb->levels_num = args->tlb_levels_num;
+    tlb->levels = malloc(tlb->levels_num * sizeof(struct cache_model *));
+    assert(NULL != tlb->levels);
+    for (i = 0; i < tlb->levels_num; i++) {
+        tlb->levels[i] = allocate_cache_model(args->tlb_levels[i].entries_num
+                                                / args->tlb_levels[i].associativity_num,
+                                                args->tlb_levels[i].associativity_num,
+                                                DEFAULT_POLICY, 0);
+    }
+    tlb->page_bits_num = __builtin_ctzl(args->page_size);
+    tlb->page_walks = 0;
+    return tlb;
+}
+
+static void destroy_tlb(struct tlb *tlb) {
+    int i;
+    for (i = 0; i < tlb->levels_num; i++) {
+        destroy_cache_model(tlb->levels[i]);
+    }
+    free(tlb->levels);
+    free(tlb);
+}
+
+static void make_tlb_step(struct tlb *tlb, unsigned long address) {
+/*
+    Function to translate the address of an access
+*/
+    unsigned long page_number = address >> tlb->page_bits_num;
+    struct cache_model *level;
+    unsigned long hits_count;
+    int i;
+    for (i = 0; i < tlb->levels_num; i++) {
+        level = tlb->levels[i];
+        hits_count = level->statistics.hits;
+        simulate_access(level, page_number % level->number_of_sets,
+                        page_number / level->number_of_sets);
+        if (hits_count != level->statistics.hits) {
+            return;
+        }
+    }
+    tlb->page_walks += 1;
+}
+
+static void print_victim_and_tlb_statistics(struct cache_model *victim, struct tlb *tlb) {
+    int i;
+    if (NULL != victim) {
+        printf("victim_hits:%lu victim_misses:%lu victim_evictions:%lu\n",
+                victim->statistics.hits, victim->statistics.misses, victim->statistics.evictions);
+    }
+    if (NULL != tlb) {
+        for (i = 0; i < tlb->levels_num; i++) {
+            printf("tlb:L%d hits:%lu misses:%lu evictions:%lu\n", i + 1,
+                    tlb->levels[i]->statistics.hits, tlb->levels[i]->statistics.misses,
+                    tlb->levels[i]->statistics.evictions);
+        }
+        printf("page_walks:%lu\n", tlb->page_walks);
+    }
+}
+
+/* END OF VICTIM CACHE AND TLB SECTION */
+
+
+/* INSTRUCTION FETCH SECTION */
+
+/* Instruction fetches are simulated as loads by the instruction cache, or by
+    the data cache (and its victim cache) in the unified mode. Their share of
+    the results is counted apart, the summary of the data cache includes it
+    in the unified mode only. */
+
+static void make_instruction_fetch_step(unsigned long address, struct cache_model *cache,
+                                    struct cache_model *victim, struct address_decoder decoder,
+                                    struct cache_statistics *fetch_statistics) {
+    struct cache_statistics statistics = cache->statistics;
+    if (NULL != victim) {
+        make_victim_cache_step(address, cache, victim, decoder);
+    } else {
+        make_cache_step(address, cache, decoder);
+    }
+    fetch_statistics->hits += cache->statistics.hits - statistics.hits;
+    fetch_statistics->misses += cache->statistics.misses - statistics.misses;
+    fetch_statistics->evictions += cache->statistics.evictions - statistics.evictions;
+}
+
+/* END OF INSTRUCTION FETCH SECTION */
+
+
+/* PERFORMANCE MEASUREMENT SECTION */
+
+static double get_time_seconds() {
+/*
+    Function to get the current value of a monotonic clock in seconds
+*/
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void print_performance(unsigned long accesses_count, double elapsed_seconds) {
+/*
+    Function to print how fast the trace was simulated
+*/
+    double accesses_per_second = 0;
+    if (elapsed_seconds > 0) {
+        accesses_per_second = accesses_count / elapsed_seconds;
+    }
+    printf("accesses:%lu time:%.3fs throughput:%.0f accesses/s\n",
+            accesses_count, elapsed_seconds, accesses_per_second);
+}
+
+static long get_peak_memory_kib() {
+/*
+    Function to get the peak resident memory of the process in KiB
+*/
+    struct rusage usage;
+    if (0 != getrusage(RUSAGE_SELF, &usage)) {
+        return -1;
+    }
+    return usage.ru_maxrss;
+}
+
+static unsigned long run_benchmark(struct passed_args *args) {
+/*
+    Main function of the benchmark. The trace is parsed once without simulation,
+    then it is simulated with every geometry (the -g ones or the -s, -E, -b one).
+    The simulation time of a geometry is its run time minus the parsing time.
+    Returns the number of accesses of all runs.
+*/
+    struct cache_geometry single_geometry = get_cache_geometry(args);
+    struct cache_geometry *geometries = &single_geometry;
+    int geometries_num = 1;
+    struct trace_reader *reader;
+    struct file_line access;
+    struct cache_model *cache;
+    struct address_decoder decoder;
+    unsigned long trace_accesses_count = 0;
+    unsigned long accesses_count;
+    double parsing_seconds, run_seconds, simulation_seconds;
+    double start_time;
+    int i;
+
+    if (args->sweep_geometries_num > 0) {
+        geometries = args->sweep_geometries;
+        geometries_num = args->sweep_geometries_num;
+    }
+    start_time = get_time_seconds();
+    reader = open_trace_reader(args->trace_file);
+    while (read_next_access(reader, &access)) {
+        trace_accesses_count += (M == access.operation) ? 2 : 1;
+    }
+    close_trace_reader(reader);
+    parsing_seconds = get_time_seconds() - start_time;
+    printf("parsing accesses:%lu time:%.3fs throughput:%.0f accesses/s\n", trace_accesses_count,
+            parsing_seconds, (parsing_seconds > 0) ? trace_accesses_count / parsing_seconds : 0);
+
+    for (i = 0; i < geometries_num; i++) {
+        start_time = get_time_seconds();
+        cache = create_cache_model(geometries[i], get_first_policy(args), args->seed);
+        decoder = create_address_decoder(geometries[i]);
+        reader = open_trace_reader(args->trace_file);
+        accesses_count = 0;
+        while (read_next_access(reader, &access)) {
+            make_cache_step(access.address, cache, decoder);
+            accesses_count++;
+            if (M == access.operation) {
+                make_cache_step(access.address, cache, decoder);
+                accesses_count++;
+            }
+        }
+        close_trace_reader(reader);
+        destroy_cache_model(cache);
+        run_seconds = get_time_seconds() - start_time;
+        simulation_seconds = (run_seconds > parsing_seconds) ? run_seconds - parsing_seconds : 0;
+        printf("s:%d E:%d b:%d time:%.3fs throughput:%.0f accesses/s simulation:%.3fs"
+                " simulation_throughput:%.0f accesses/s\n",
+                geometries[i].set_index_bits_num, geometries[i].associativity_num,
+                geometries[i].block_bits_num, run_seconds,
+                (run_seconds > 0) ? accesses_count / run_seconds : 0, simulation_seconds,
+                (simulation_seconds > 0) ? accesses_count / simulation_seconds : 0);
+    }
+    printf("peak_memory:%ld KiB\n", get_peak_memory_kib());
+    return trace_accesses_count * (geometries_num + 1);
+}
+
+/* END OF PERFORMANCE MEASUREMENT SECTION */
+
+
+/* TIME SERIES SECTION */
+
+/* The results of every window of accesses are formatted into a buffer that is
+    written when it is full, so a window costs a few string conversions and
+    an access only a comparison. A window ends at the first access that makes
+    the number of simulated accesses reach a multiple of the window size
+    (a modification, counted as two accesses, is not split). */
+
+# define WINDOW_BUFFER_SIZE (1 << 16)
+# define WINDOW_FIELD_MAX_LENGTH 64  // longest formatted field
+
+struct window_stream {
+/*
+    Structure that represents the stream of windows and its buffer.
+*/
+    FILE *output;
+    char *file_name;
+    int json_flag;
+    int occupancy_flag;
+    unsigned long window_size;
+    unsigned long window_end;  // number of accesses at which the current window ends
+    unsigned long windows_num;
+    struct cache_statistics last_statistics;  // at the end of the previous window
+    char buffer[WINDOW_BUFFER_SIZE];
+    size_t buffer_used;
+};
+
+static void flush_window_stream(struct window_stream *stream) {
+    if (stream->buffer_used != fwrite(stream->buffer, 1, stream->buffer_used, stream->output)) {
+        printf("Cannot write to file %s\n", stream->file_name);
+        exit(EXIT_FAILURE);
+    }
+    stream->buffer_used = 0;
+}
+
+static void append_to_window_stream(struct window_stream *stream, const char *format, unsigned long value) {
+/*
+    Function to format a field (with at most one value) into the buffer
+*/
+    if (stream->buffer_used + WINDOW_FIELD_MAX_LENGTH > WINDOW_BUFFER_SIZE) {
+        flush_window_stream(stream);
+    }
+    stream->buffer_used += snprintf(stream->buffer + stream->buffer_used,
+                                    WINDOW_BUFFER_SIZE - stream->buffer_used, format, value);
+}
+
+static struct window_stream *open_window_stream(struct passed_args *args, int number_of_sets) {
+/*
+    Function to open the stream of windows, the CSV header is written at once
+*/
+    struct window_stream *stream = malloc(sizeof(struct window_stream));
+    int i;
+    assert(NULL != stream);
+    stream->file_name = (NULL != args->window_output_file) ? args->window_output_file : "<stdout>";
+    stream->output = (NULL != args->window_output_file) ? fopen(args->window_output_file, "w") : stdout;
+    if (NULL == stream->output) {
+        printf("Cannot open file %s\n", args->window_output_file);
+        exit(EXIT_FAILURE);
+    }
+    stream->json_flag = args->window_json_flag;
+    stream->occupancy_flag = args->window_occupancy_flag;
+    stream->window_size = args->window_size;
+    stream->window_end = args->window_size;
+    stream->windows_num = 0;
+    memset(&(stream->last_statistics), 0, sizeof(struct cache_statistics));
+    stream->buffer_used = 0;
+    if (!stream->json_flag) {
+        append_to_window_stream(stream, "window,accesses,hits,misses,evictions", 0);
+        for (i = 0; stream->occupancy_flag && i < number_of_sets; i++) {
+            append_to_window_stream(stream, ",set%lu", i);
+        }
+        append_to_window_stream(stream, "\n", 0);
+    }
+    return stream;
+}
+
+static void write_window(struct window_stream *stream, struct cache_model *cache,
+                    unsigned long accesses_count) {
+/*
+    Function to write the results of the window that ends after accesses_count accesses
+*/
+    struct cache_statistics *last = &(stream->last_statistics);
+    int json_flag = stream->json_flag;
+    int i;
+    append_to_window_stream(stream, json_flag ? "{\"window\":%lu" : "%lu", stream->windows_num);
+    append_to_window_stream(stream, json_flag ? ",\"accesses\":%lu" : ",%lu", accesses_count);
+    append_to_window_stream(stream, json_flag ? ",\"hits\":%lu" : ",%lu",
+                            cache->statistics.hits - last->hits);
+    append_to_window_stream(stream, json_flag ? ",\"misses\":%lu" : ",%lu",
+                            cache->statistics.misses - last->misses);
+    append_to_window_stream(stream, json_flag ? ",\"evictions\":%lu" : ",%lu",
+                            cache->statistics.evictions - last->evictions);
+    if (stream->occupancy_flag) {
+        if (json_flag) {
+            append_to_window_stream(stream, ",\"occupancy\":[", 0);
+        }
+        for (i = 0; i < cache->number_of_sets; i++) {
+            append_to_window_stream(stream, (json_flag && 0 == i) ? "%lu" : ",%lu",
+                                    __builtin_popcountll(cache->valid_lines[i]));
+        }
+        if (json_flag) {
+            append_to_window_stream(stream, "]", 0);
+        }
+    }
+    append_to_window_stream(stream, json_flag ? "}\n" : "\n", 0);
+    *last = cache->statistics;
+    stream->windows_num++;
+}
+
+static void advance_window_stream(struct window_stream *stream, struct cache_model *cache,
+                            unsigned long accesses_count) {
+/*
+    Function called after every trace line, writes the window if it is complete
+*/
+    if (accesses_count >= stream->window_end) {
+        write_window(stream, cache, accesses_count);
+        while (stream->window_end <= accesses_count) {
+            stream->window_end += stream->window_size;
+        }
+    }
+}
+
+static void close_window_stream(struct window_stream *stream, struct cache_model *cache,
+                            unsigned long accesses_count) {
+/*
+    Function to write the last (incomplete) window and to close the stream
+*/
+    if (accesses_count > stream->window_end - stream->window_size) {
+        write_window(stream, cache, accesses_count);
+    }
+    flush_window_stream(stream);
+    if (stdout != stream->output && 0 != fclose(stream->output)) {
+        printf("Cannot write to file %s\n", stream->file_name);
+        exit(EXIT_FAILURE);
+    }
+    free(stream);
+}
+
+/* END OF TIME SERIES SECTION */
+
+
+/* SWEEP MODE SECTION */
+
+/* In the sweep mode the trace is read once and the accesses are passed
+    by batches to the models of all swept geometries */
+# define ACCESS_BATCH_SIZE 65536
+
+struct access_batch {
+/*
+    Structure to store a batch of decoded accesses of the trace file.
+*/
+    struct file_line accesses[ACCESS_BATCH_SIZE];
+    int count;
+};
+
+struct sweep_configuration {
+/*
+    Structure that represents one of the simulated geometries
+    with one of the simulated replacement policies.
+*/
+    struct cache_geometry geometry;
+    struct address_decoder decoder;
+    struct cache_model *cache;
+};
+
+struct sweep_state {
+/*
+    Structure shared by the threads of the sweep mode. The reading thread fills
+    one batch while the workers simulate the other one. Both switch to the other
+    batch after meeting at the barrier.
+*/
+    struct sweep_configuration *configurations;
+    int configurations_num;
+    struct access_batch batches[2];
+    pthread_barrier_t barrier;
+    int threads_num;
+};
+
+struct sweep_worker {
+/*
+    Structure to pass the arguments to a worker thread. A worker simulates
+    configurations worker_index, worker_index + threads_num, ...
+*/
+    struct sweep_state *sweep;
+    int worker_index;
+    pthread_t thread;
+};
+
+static int fill_access_batch(struct trace_reader *reader, struct access_batch *batch) {
+/*
+    Function to read the next accesses of the trace file into the passed batch.
+    Returns the number of stored accesses, 0 when the file is over.
+*/
+    batch->count = 0;
+    while (batch->count < ACCESS_BATCH_SIZE
+            && read_next_access(reader, &(batch->accesses[batch->count]))) {
+        batch->count++;
+    }
+    return batch->count;
+}
+
+static void simulate_batch(struct sweep_configuration *configuration, struct access_batch *batch) {
+/*
+    Function to replay a batch of accesses on the cache model of a configuration
+*/
+    struct cache_model *cache = configuration->cache;
+    struct address_decoder decoder = configuration->decoder;
+    struct file_line *access;
+    int i;
+    for (i = 0; i < batch->count; i++) {
+        access = &(batch->accesses[i]);
+        make_cache_step(access->address, cache, decoder);
+        if (M == access->operation) {
+            make_cache_step(access->address, cache, decoder);
+        }
+    }
+}
+
+static void *sweep_worker_routine(void *worker_arg) {
+/*
+    Main function of a worker thread of the sweep mode
+*/
+    struct sweep_worker *worker = worker_arg;
+    struct sweep_state *sweep = worker->sweep;
+    struct access_batch *batch;
+    int batch_index = 0;
+    int i;
+    while (1) {
+        /* Waiting until the reading thread fills the batch */
+        pthread_barrier_wait(&(sweep->barrier));
+        batch = &(sweep->batches[batch_index]);
+        if (0 == batch->count) {
+            break;
+        }
+        for (i = worker->worker_index; i < sweep->configurations_num; i += sweep->threads_num) {
+            simulate_batch(&(sweep->configurations[i]), batch);
+        }
+        batch_index ^= 1;
+    }
+    return NULL;
+}
+
+static void run_sweep_serial(struct sweep_state *sweep, struct trace_reader *reader) {
+    struct access_batch *batch = &(sweep->batches[0]);
+    int i;
+    while (fill_access_batch(reader, batch)) {
+        for (i = 0; i < sweep->configurations_num; i++) {
+            simulate_batch(&(sweep->configurations[i]), batch);
+        }
+    }
+}
+
+static void run_sweep_parallel(struct sweep_state *sweep, struct trace_reader *reader) {
+/*
+    Function to simulate the configurations with several worker threads,
+    while the calling thread reads the trace
+*/
+    struct sweep_worker *workers = malloc(sweep->threads_num * sizeof(struct sweep_worker));
+    int batch_index = 0;
+    int i;
+    assert(NULL != workers);
+    pthread_barrier_init(&(sweep->barrier), NULL, sweep->threads_num + 1);
+    for (i = 0; i < sweep->threads_num; i++) {
+        workers[i].sweep = sweep;
+        workers[i].worker_index = i;
+        pthread_create(&(workers[i].thread), NULL, sweep_worker_routine, &(workers[i]));
+    }
+
+    fill_access_batch(reader, &(sweep->batches[batch_index]));
+    while (1) {
+        /* After the barrier the workers start simulating the filled batch
+            and they are done with the other one */
+        pthread_barrier_wait(&(sweep->barrier));
+        if (0 == sweep->batches[batch_index].count) {
+            break;
+        }
+        batch_index ^= 1;
+        fill_access_batch(reader, &(sweep->batches[batch_index]));
+    }
+
+    for (i = 0; i < sweep->threads_num; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    pthread_barrier_destroy(&(sweep->barrier));
+    free(workers);
+}
+
+static void print_sweep_row(struct passed_args *args, struct sweep_configuration *configuration) {
+/*
+    Function to print the results of a configuration. If the sweep mode is
+    used to simulate several policies with a single geometry, the results
+    are printed by printSummary.
+*/
+    struct cache_statistics statistics = configuration->cache->statistics;
+    if (args->policies_num > 0) {
+        printf("policy:%s ", configuration->cache->policy->name);
+    }
+    if (0 == args->sweep_geometries_num) {
+        printSummary(statistics.hits, statistics.misses, statistics.evictions);
+        return;
+    }
+    printf("s:%d E:%d b:%d hits:%lu misses:%lu evictions:%lu\n",
+            configuration->geometry.set_index_bits_num,
+            configuration->geometry.associativity_num,
+            configuration->geometry.block_bits_num,
+            statistics.hits, statistics.misses, statistics.evictions);
+}
+
+static unsigned long run_sweep(struct passed_args *args) {
+/*
+    Main function of the sweep mode: simulates all passed geometries
+    (or the -s, -E, -b geometry if none is passed) with all passed policies
+    with a single pass over the trace file and prints one result row per
+    configuration. Returns the number of simulated accesses.
+*/
+    struct sweep_state *sweep = malloc(sizeof(struct sweep_state));
+    struct sweep_configuration *configuration;
+    struct trace_reader *reader;
+    struct cache_geometry *geometries = args->sweep_geometries;
+    int geometries_num = args->sweep_geometries_num;
+    struct cache_geometry single_geometry = get_cache_geometry(args);
+    const struct replacement_policy *default_policy = DEFAULT_POLICY;
+    const struct replacement_policy **policies = args->policies;
+    int policies_num = args->policies_num;
+    unsigned long accesses_count = 0;
+    int i;
+    assert(NULL != sweep);
+    if (0 == geometries_num) {
+        geometries = &single_geometry;
+        geometries_num = 1;
+    }
+    if (0 == policies_num) {
+        policies = &default_policy;
+        policies_num = 1;
+    }
+    sweep->configurations_num = geometries_num * policies_num;
+    sweep->configurations = malloc(sweep->configurations_num * sizeof(struct sweep_configuration));
+    assert(NULL != sweep->configurations);
+    sweep->threads_num = args->threads_num;
+    if (sweep->threads_num > sweep->configurations_num) {
+        sweep->threads_num = sweep->configurations_num;
+    }
+    for (i = 0; i < sweep->configurations_num; i++) {
+        configuration = &(sweep->configurations[i]);
+        configuration->geometry = geometries[i / policies_num];
+        configuration->decoder = create_address_decoder(configuration->geometry);
+        configuration->cache = create_cache_model(configuration->geometry,
+                                                    policies[i % policies_num], args->seed);
+    }
+
+    reader = open_trace_reader(args->trace_file);
+    if (sweep->threads_num > 1) {
+        run_sweep_parallel(sweep, reader);
+    } else {
+        run_sweep_serial(sweep, reader);
+    }
+    close_trace_reader(reader);
+
+    for (i = 0; i < sweep->configurations_num; i++) {
+        configuration = &(sweep->configurations[i]);
+        print_sweep_row(args, configuration);
+        accesses_count += configuration->cache->statistics.hits
+                            + configuration->cache->statistics.misses;
+        destroy_cache_model(configuration->cache);
+    }
+    free(sweep->configurations);
+    free(sweep);
+    return accesses_count;
+}
+
+/* END OF SWEEP MODE SECTION */
+
+
+/* SET SHARDING SECTION */
+
+/* Sets of the cache are independent, so they can be simulated by several threads.
+    The reading thread sends every access to the thread that owns its set:
+    thread k owns sets k, k + threads_num, ... and stores set i at index
+    i / threads_num of its own cache model. Accesses to a set are simulated
+    in the order of the trace, so the results are the same as with one thread. */
+
+/* Number of batches that circulate between the reading thread and a worker */
+# define SHARD_BATCHES_NUM 4
+
+struct batch_queue {
+/*
+    Bounded blocking queue of batches shared by two threads.
+*/
+    struct access_batch *slots[SHARD_BATCHES_NUM];
+    int head;
+    int count;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+};
+
+struct set_shard {
+/*
+    Structure that represents the part of the cache simulated by a worker.
+*/
+    struct cache_model *cache;
+    struct address_decoder decoder;
+    int shards_num;
+    struct batch_queue filled_batches;  // batches to simulate
+    struct batch_queue free_batches;  // simulated batches that may be filled again
+    struct access_batch *batches[SHARD_BATCHES_NUM];
+    struct access_batch *current_batch;  // batch that is being filled
+    pthread_t thread;
+};
+
+static void init_batch_queue(struct batch_queue *queue) {
+    queue->head = 0;
+    queue->count = 0;
+    pthread_mutex_init(&(queue->mutex), NULL);
+    pthread_cond_init(&(queue->changed), NULL);
+}
+
+static void destroy_batch_queue(struct batch_queue *queue) {
+    pthread_mutex_destroy(&(queue->mutex));
+    pthread_cond_destroy(&(queue->changed));
+}
+
+static void push_batch(struct batch_queue *queue, struct access_batch *batch) {
+    pthread_mutex_lock(&(queue->mutex));
+    while (SHARD_BATCHES_NUM == queue->count) {
+        pthread_cond_wait(&(queue->changed), &(queue->mutex));
+    }
+    queue->slots[(queue->head + queue->count) % SHARD_BATCHES_NUM] = batch;
+    queue->count++;
+    pthread_cond_signal(&(queue->changed));
+    pthread_mutex_unlock(&(queue->mutex));
+}
+
+static struct access_batch *pop_batch(struct batch_queue *queue) {
+    struct access_batch *batch;
+    pthread_mutex_lock(&(queue->mutex));
+    while (0 == queue->count) {
+        pthread_cond_wait(&(queue->changed), &(queue->mutex));
+    }
+    batch = queue->slots[queue->head];
+    queue->head = (queue->head + 1) % SHARD_BATCHES_NUM;
+    queue->count--;
+    pthread_cond_signal(&(queue->changed));
+    pthread_mutex_unlock(&(queue->mutex));
+    return batch;
+}
+
+static void *set_shard_routine(void *shard_arg) {
+/*
+    Main function of a worker thread: simulates the batches of its sets
+    until an empty batch is received
+*/
+    struct set_shard *shard = shard_arg;
+    struct access_batch *batch;
+    struct address_separated addr_sep;
+    long local_set_index;
+    int i;
+    while (1) {
+        batch = pop_batch(&(shard->filled_batches));
+        if (0 == batch->count) {
+            break;
+        }
+        for (i = 0; i < batch->count; i++) {
+            addr_sep = separate_address(batch->accesses[i].address, shard->decoder);
+            local_set_index = addr_sep.set_index / shard->shards_num;
+            simulate_access(shard->cache, local_set_index, addr_sep.line_tag);
+            if (M == batch->accesses[i].operation) {
+                simulate_access(shard->cache, local_set_index, addr_sep.line_tag);
+            }
+        }
+        batch->count = 0;
+        push_batch(&(shard->free_batches), batch);
+    }
+    return NULL;
+}
+
+static void send_current_batch(struct set_shard *shard) {
+/*
+    Function to pass the batch that is being filled to the worker
+    and to get a free one instead
+*/
+    push_batch(&(shard->filled_batches), shard->current_batch);
+    shard->current_batch = pop_batch(&(shard->free_batches));
+}
+
+static struct cache_statistics run_set_shards(struct passed_args *args, unsigned long *accesses_count) {
+/*
+    Main function of the section: simulates the trace with several threads
+    and returns the merged results
+*/
+    struct cache_geometry geometry = get_cache_geometry(args);
+    struct address_decoder decoder = create_address_decoder(geometry);
+    int number_of_sets = get_number_of_sets(geometry.set_index_bits_num);
+    int shards_num = args->threads_num;
+    struct set_shard *shards;
+    struct set_shard *shard;
+    struct trace_reader *reader;
+    struct file_line access;
+    struct cache_statistics statistics = {0, 0, 0};
+    int i, j;
+
+    if (shards_num > number_of_sets) {
+        shards_num = number_of_sets;
+    }
+    shards = malloc(shards_num * sizeof(struct set_shard));
+    assert(NULL != shards);
+    for (i = 0; i < shards_num; i++) {
+        shard = &(shards[i]);
+        /* Shard i owns the sets i, i + shards_num, ... */
+        shard->cache = allocate_cache_model((number_of_sets - i + shards_num - 1) / shards_num,
+                                            geometry.associativity_num,
+                                            get_first_policy(args), args->seed);
+        shard->decoder = decoder;
+        shard->shards_num = shards_num;
+        init_batch_queue(&(shard->filled_batches));
+        init_batch_queue(&(shard->free_batches));
+        for (j = 0; j < SHARD_BATCHES_NUM; j++) {
+            shard->batches[j] = malloc(sizeof(struct access_batch));
+            assert(NULL != shard->batches[j]);
+            shard->batches[j]->count = 0;
+        }
+        for (j = 1; j < SHARD_BATCHES_NUM; j++) {
+            push_batch(&(shard->free_batches), shard->batches[j]);
+        }
+        shard->current_batch = shard->batches[0];
+        pthread_create(&(shard->thread), NULL, set_shard_routine, shard);
+    }
+
+    reader = open_trace_reader(args->trace_file);
+    while (read_next_access(reader, &access)) {
+        shard = &(shards[get_set_index(access.address, decoder) % shards_num]);
+        shard->current_batch->accesses[shard->current_batch->count] = access;
+        shard->current_batch->count++;
+        if (ACCESS_BATCH_SIZE == shard->current_batch->count) {
+            send_current_batch(shard);
+        }
+        *accesses_count += (M == access.operation) ? 2 : 1;
+    }
+    close_trace_reader(reader);
+
+    for (i = 0; i < shards_num; i++) {
+        shard = &(shards[i]);
+        if (shard->current_batch->count > 0) {
+            send_current_batch(shard);
+        }
+        /* An empty batch stops the worker */
+        push_batch(&(shard->filled_batches), shard->current_batch);
+    }
+    for (i = 0; i < shards_num; i++) {
+        shard = &(shards[i]);
+        pthread_join(shard->thread, NULL);
+        statistics.hits += shard->cache->statistics.hits;
+        statistics.misses += shard->cache->statistics.misses;
+        statistics.evictions += shard->cache->statistics.evictions;
+        destroy_cache_model(shard->cache);
+        destroy_batch_queue(&(shard->filled_batches));
+        destroy_batch_queue(&(shard->free_batches));
+        for (j = 0; j < SHARD_BATCHES_NUM; j++) {
+            free(shard->batches[j]);
+        }
+    }
+    free(shards);
+    return statistics;
+}
+
+/* END OF SET SHARDING SECTION */
 
 
-/* PASSED ARGUMENTS HELPERS SECTION */
+/* PIPELINE SECTION */
 
-char get_set_bits_num(struct passed_args *args) {
-    char set_bits_num = args->set_index_bits_num;
-    return set_bits_num;
+/* In the pipeline mode a thread reads the trace by chunks of complete lines,
+    parsing threads decode them into batches and the main thread simulates the
+    batches. Chunks are given to the parsers in turn and the batches are taken
+    back in the same order, so every queue has a single producer and a single
+    consumer and is a lock-free ring. Buffers return to their producer through
+    a ring going the other way. */
+
+/* A data line has at least 5 bytes (" L 0\n"), so a chunk always fits a batch */
+# define PIPELINE_CHUNK_SIZE (ACCESS_BATCH_SIZE * 4)
+# define PIPELINE_BUFFERS_NUM 4
+# define PIPELINE_RING_SIZE 8  // a power of two not smaller than PIPELINE_BUFFERS_NUM
+# define PIPELINE_END_OF_TRACE -1  // count of the batch sent after the last one
+
+struct spsc_ring {
+/*
+    Structure that represents a lock-free ring with a single producer and a single consumer.
+    The indexes are only increased, the slot of an index is index % PIPELINE_RING_SIZE.
+*/
+    void *slots[PIPELINE_RING_SIZE];
+    _Atomic size_t head __attribute__((aligned(HOST_CACHE_LINE_SIZE)));  // written by the consumer
+    _Atomic size_t tail __attribute__((aligned(HOST_CACHE_LINE_SIZE)));  // written by the producer
+};
+
+struct trace_chunk {
+    char *data;  // one extra byte is allocated to terminate the last line
+    size_t size;
+};
+
+struct pipeline_parser {
+/*
+    Structure to store the state of a parsing thread and its rings.
+*/
+    pthread_t thread;
+    struct spsc_ring filled_chunks;
+    struct spsc_ring free_chunks;
+    struct spsc_ring filled_batches;
+    struct spsc_ring free_batches;
+    struct trace_chunk chunks[PIPELINE_BUFFERS_NUM];
+    struct access_batch *batches[PIPELINE_BUFFERS_NUM];
+    double busy_time;
+    unsigned long accesses_count;
+};
+
+struct pipeline {
+    struct trace_reader *reader;
+    pthread_t reader_thread;
+    struct pipeline_parser *parsers;
+    int parsers_num;
+    double read_busy_time;
+    unsigned long bytes_read;
+};
+
+static void init_ring(struct spsc_ring *ring) {
+    atomic_init(&(ring->head), 0);
+    atomic_init(&(ring->tail), 0);
 }
 
-char get_lines_num(struct passed_args *args) {
-    char lines_num = args->associativity_num;
-    return lines_num;
+static void push_to_ring(struct spsc_ring *ring, void *item) {
+    size_t tail = atomic_load_explicit(&(ring->tail), memory_order_relaxed);
+    while (tail - atomic_load_explicit(&(ring->head), memory_order_acquire) == PIPELINE_RING_SIZE) {
+        sched_yield();
+    }
+    ring->slots[tail % PIPELINE_RING_SIZE] = item;
+    atomic_store_explicit(&(ring->tail), tail + 1, memory_order_release);
 }
 
-char get_block_bits_num(struct passed_args *args) {
-    char block_bits_num = args->block_bits_num;
-    return block_bits_num;
+static void *pop_from_ring(struct spsc_ring *ring) {
+    size_t head = atomic_load_explicit(&(ring->head), memory_order_relaxed);
+    void *item;
+    while (atomic_load_explicit(&(ring->tail), memory_order_acquire) == head) {
+        sched_yield();
+    }
+    item = ring->slots[head % PIPELINE_RING_SIZE];
+    atomic_store_explicit(&(ring->head), head + 1, memory_order_release);
+    return item;
+}
+
+static size_t read_trace_chunk(struct trace_reader *reader, char *destination) {
+/*
+    Function to copy the next complete lines of the trace (at most PIPELINE_CHUNK_SIZE bytes).
+    Returns the number of bytes copied, 0 when the file is over.
+*/
+    size_t bytes_left = reader->size - reader->position;
+    size_t chunk_size;
+    char *chunk_start;
+    char *last_line_end;
+    if (bytes_left < PIPELINE_CHUNK_SIZE && !reader->eof) {
+        refill_trace_buffer(reader);
+        bytes_left = reader->size - reader->position;
+    }
+    chunk_start = reader->buffer + reader->position;
+    chunk_size = bytes_left;
+    if (chunk_size > PIPELINE_CHUNK_SIZE) {
+        chunk_size = PIPELINE_CHUNK_SIZE;
+    }
+    /* Only the last line of the file may be sent without its '\n' */
+    if (chunk_size < bytes_left || !reader->eof) {
+        last_line_end = memrchr(chunk_start, '\n', chunk_size);
+        if (NULL == last_line_end) {
+            printf("The file being parsed contains a line longer than %d bytes.\n",
+                    PIPELINE_CHUNK_SIZE);
+            exit(EXIT_SUCCESS);
+        }
+        chunk_size = last_line_end - chunk_start + 1;
+    }
+    memcpy(destination, chunk_start, chunk_size);
+    reader->position += chunk_size;
+    return chunk_size;
 }
 
-char *get_trace_file(struct passed_args *args) {
-    char *trace_file = args->trace_file;
-    return trace_file;
+static void parse_trace_chunk(struct trace_chunk *chunk, struct access_batch *batch) {
+/*
+    Function to decode the accesses of the lines of a chunk
+*/
+    char *line = chunk->data;
+    char *chunk_end = chunk->data + chunk->size;
+    char *line_end;
+    *chunk_end = '\0';
+    batch->count = 0;
+    while (line < chunk_end) {
+        line_end = memchr(line, '\n', chunk_end - line);
+        if (NULL == line_end) {
+            line_end = chunk_end;
+        }
+        *line_end = '\0';
+        if (parse_trace_line(line, &(batch->accesses[batch->count]), 0)) {
+            batch->count++;
+        }
+        line = line_end + 1;
+    }
 }
 
-int get_help_flag(struct passed_args *args) {
-    int help_flag = args->help_flag;
-    return help_flag;
+static void *pipeline_reader_routine(void *pipeline_arg) {
+/*
+    Main function of the reading thread: sends chunks to the parsers in turn.
+    When the file is over an empty chunk is sent to every parser.
+*/
+    struct pipeline *pipeline = pipeline_arg;
+    struct pipeline_parser *parser;
+    struct trace_chunk *chunk;
+    double start_time;
+    int parser_index = 0;
+    int parsers_finished = 0;
+    while (parsers_finished < pipeline->parsers_num) {
+        parser = &(pipeline->parsers[parser_index]);
+        chunk = pop_from_ring(&(parser->free_chunks));
+        if (0 == parsers_finished) {
+            start_time = get_time_seconds();
+            chunk->size = read_trace_chunk(pipeline->reader, chunk->data);
+            pipeline->read_busy_time += get_time_seconds() - start_time;
+            pipeline->bytes_read += chunk->size;
+        } else {
+            chunk->size = 0;
+        }
+        if (0 == chunk->size) {
+            parsers_finished++;
+        }
+        push_to_ring(&(parser->filled_chunks), chunk);
+        parser_index = (parser_index + 1) % pipeline->parsers_num;
+    }
+    return NULL;
 }
 
-int get_verbose_flag(struct passed_args *args) {
-    int verbose_flag = args->verbose_flag;
-    return verbose_flag;
+static void *pipeline_parser_routine(void *parser_arg) {
+/*
+    Main function of a parsing thread: decodes the chunks until an empty one
+*/
+    struct pipeline_parser *parser = parser_arg;
+    struct trace_chunk *chunk;
+    struct access_batch *batch;
+    double start_time;
+    while (1) {
+        chunk = pop_from_ring(&(parser->filled_chunks));
+        batch = pop_from_ring(&(parser->free_batches));
+        if (0 == chunk->size) {
+            batch->count = PIPELINE_END_OF_TRACE;
+            push_to_ring(&(parser->filled_batches), batch);
+            break;
+        }
+        start_time = get_time_seconds();
+        parse_trace_chunk(chunk, batch);
+        parser->busy_time += get_time_seconds() - start_time;
+        parser->accesses_count += batch->count;
+        push_to_ring(&(parser->free_chunks), chunk);
+        push_to_ring(&(parser->filled_batches), batch);
+    }
+    return NULL;
 }
 
-/* END OF PASSED ARGUMENTS HELPERS SECTION */
+static void init_pipeline_parser(struct pipeline_parser *parser) {
+    int i;
+    init_ring(&(parser->filled_chunks));
+    init_ring(&(parser->free_chunks));
+    init_ring(&(parser->filled_batches));
+    init_ring(&(parser->free_batches));
+    for (i = 0; i < PIPELINE_BUFFERS_NUM; i++) {
+        parser->chunks[i].data = malloc(PIPELINE_CHUNK_SIZE + 1);
+        assert(NULL != parser->chunks[i].data);
+        parser->batches[i] = malloc(sizeof(struct access_batch));
+        assert(NULL != parser->batches[i]);
+        push_to_ring(&(parser->free_chunks), &(parser->chunks[i]));
+        push_to_ring(&(parser->free_batches), parser->batches[i]);
+    }
+    parser->busy_time = 0;
+    parser->accesses_count = 0;
+}
 
+static void destroy_pipeline_parser(struct pipeline_parser *parser) {
+    int i;
+    for (i = 0; i < PIPELINE_BUFFERS_NUM; i++) {
+        free(parser->chunks[i].data);
+        free(parser->batches[i]);
+    }
+}
 
-/* CACHE MODEL SECTION */
+static void print_stage_performance(const char *stage, int threads_num, unsigned long count,
+                                const char *unit, double busy_time) {
+/*
+    Function to print the time a stage was busy and its throughput when busy.
+    The stage with the longest busy time per thread bounds the run.
+*/
+    printf("stage:%s threads:%d %s:%lu busy:%.3fs throughput:%.0f %s/s\n",
+            stage, threads_num, unit, count, busy_time,
+            (busy_time > 0) ? count * threads_num / busy_time : 0, unit);
+}
 
-int two_to_pow(int pow) {
+static struct cache_statistics run_pipeline(struct passed_args *args, unsigned long *accesses_count) {
 /*
-    Function that returns two to the power of pow.
-    It is used for computing the number of cache sets or blocks of sets' lines.
+    Main function of the pipeline mode: the main thread simulates the batches
+    decoded by the parsing threads. Returns the statistics of the cache.
 */
-    int result = 1;
-    int i = 0;
-    for (i = 0; i < pow; i++) {
-        result *= 2;
+    struct pipeline pipeline;
+    struct pipeline_parser *parser;
+    struct access_batch *batch;
+    struct cache_model *cache = create_cache_model(get_cache_geometry(args), get_first_policy(args), args->seed);
+    struct address_decoder decoder = create_address_decoder(get_cache_geometry(args));
+    struct cache_statistics statistics;
+    double simulation_busy_time = 0;
+    double start_time;
+    int parser_index = 0;
+    int i;
+
+    pipeline.reader = open_trace_reader(args->trace_file);
+    if (NULL != pipeline.reader->binary_data) {
+        printf("The pipeline mode needs a text trace, binary traces are not parsed\n");
+        exit(EXIT_SUCCESS);
     }
-    return result;
+    pipeline.parsers_num = args->pipeline_parsers_num;
+    pipeline.parsers = malloc(pipeline.parsers_num * sizeof(struct pipeline_parser));
+    assert(NULL != pipeline.parsers);
+    pipeline.read_busy_time = 0;
+    pipeline.bytes_read = 0;
+    for (i = 0; i < pipeline.parsers_num; i++) {
+        init_pipeline_parser(&(pipeline.parsers[i]));
+        pthread_create(&(pipeline.parsers[i].thread), NULL, pipeline_parser_routine,
+                        &(pipeline.parsers[i]));
+    }
+    pthread_create(&(pipeline.reader_thread), NULL, pipeline_reader_routine, &pipeline);
+
+    *accesses_count = 0;
+    while (1) {
+        parser = &(pipeline.parsers[parser_index]);
+        batch = pop_from_ring(&(parser->filled_batches));
+        if (PIPELINE_END_OF_TRACE == batch->count) {
+            break;
+        }
+        start_time = get_time_seconds();
+        for (i = 0; i < batch->count; i++) {
+            make_cache_step(batch->accesses[i].address, cache, decoder);
+            (*accesses_count)++;
+            if (M == batch->accesses[i].operation) {
+                make_cache_step(batch->accesses[i].address, cache, decoder);
+                (*accesses_count)++;
+            }
+        }
+        simulation_busy_time += get_time_seconds() - start_time;
+        push_to_ring(&(parser->free_batches), batch);
+        parser_index = (parser_index + 1) % pipeline.parsers_num;
+    }
+
+    pthread_join(pipeline.reader_thread, NULL);
+    for (i = 0; i < pipeline.parsers_num; i++) {
+        pthread_join(pipeline.parsers[i].thread, NULL);
+    }
+    if (args->performance_flag) {
+        print_stage_performance("read", 1, pipeline.bytes_read, "bytes", pipeline.read_busy_time);
+        for (i = 1; i < pipeline.parsers_num; i++) {
+            pipeline.parsers[0].busy_time += pipeline.parsers[i].busy_time;
+            pipeline.parsers[0].accesses_count += pipeline.parsers[i].accesses_count;
+        }
+        /* The busy time of the parsers is summed, the throughput is the one of all of them */
+        print_stage_performance("parse", pipeline.parsers_num, pipeline.parsers[0].accesses_count,
+                                "accesses", pipeline.parsers[0].busy_time);
+        print_stage_performance("simulate", 1, *accesses_count, "accesses", simulation_busy_time);
+    }
+    for (i = 0; i < pipeline.parsers_num; i++) {
+        destroy_pipeline_parser(&(pipeline.parsers[i]));
+    }
+    free(pipeline.parsers);
+    close_trace_reader(pipeline.reader);
+    statistics = cache->statistics;
+    destroy_cache_model(cache);
+    return statistics;
 }
 
-int get_number_of_sets(char set_bits_num) {
+/* END OF PIPELINE SECTION */
+
+
+/* STACK DISTANCE SECTION */
+
+/* In this mode the LRU stack distance of every access is computed: the number
+    of distinct lines of the set accessed since the previous access to the same
+    line. An access hits in a LRU cache of associativity E if and only if its
+    stack distance is smaller than E, so a single pass gives the results for
+    all associativities.
+    The lines above the previous access in the stack are counted with
+    a Fenwick tree over the access positions of the set: a position is marked
+    while it is the last access of its line. */
+
+# define REUSE_STACK_INITIAL_CAPACITY 16
+# define LINE_TABLE_INITIAL_BUCKETS 1024
+# define NO_LINE_ENTRY (-1)
+
+struct line_entry {
 /*
-    Function for computing the number of sets.
+    Structure to store the position of the last access to a line.
 */
-    int number_of_sets = two_to_pow(set_bits_num);
-    return number_of_sets;
+    unsigned long line_address;
+    long position;
+    long next;  // next entry of the same hash table bucket
+};
+
+struct line_table {
+/*
+    Hash table (with chaining) of all accessed lines. Entries are never
+    removed, so their indexes do not change when the table grows.
+*/
+    struct line_entry *entries;
+    long entries_num;
+    long entries_capacity;
+    long *buckets;
+    long buckets_num;  // power of two
+};
+
+struct reuse_stack {
+/*
+    Structure to represent the LRU stack of a set.
+*/
+    unsigned int *tree;  // Fenwick tree over the positions, indexed from 1
+    long *owners;  // entry of the line last accessed at a position or NO_LINE_ENTRY
+    long capacity;
+    long top;  // position of the next access
+    long lines_num;  // number of distinct lines accessed in the set
+};
+
+struct stack_distance_engine {
+/*
+    Structure to store the state of the stack distance computation.
+*/
+    struct cache_geometry geometry;
+    struct address_decoder decoder;
+    struct line_table table;
+    struct reuse_stack *stacks;
+    long stacks_num;
+    unsigned long *distance_counts;  // number of accesses of each stack distance
+    long distance_counts_size;
+    unsigned long cold_accesses;  // first accesses to the lines
+    unsigned long accesses_num;
+};
+
+/* Fenwick tree subsection */
+
+static void fenwick_add(unsigned int *tree, long capacity, long position, int delta) {
+    long i;
+    for (i = position + 1; i <= capacity; i += i & (-i)) {
+        tree[i] += delta;
+    }
 }
 
-int get_number_of_blocks(char block_bits_num)
+static unsigned long fenwick_prefix_sum(unsigned int *tree, long positions_num) {
 /*
-    Function for computing the number of blocks.
+    Function to get the number of marked positions among the first positions_num ones
 */
-{
-    int number_of_blocks = two_to_pow(block_bits_num);
-    return number_of_blocks;
+    unsigned long sum = 0;
+    long i;
+    for (i = positions_num; i > 0; i -= i & (-i)) {
+        sum += tree[i];
+    }
+    return sum;
 }
 
-/* The following functions are used for generating the cache model */
+/* End of Fenwick tree subsection */
+
+static unsigned long hash_line_address(unsigned long line_address) {
+    return (line_address * 0x9E3779B97F4A7C15UL) ^ (line_address >> 29);
+}
+
+static void init_line_table(struct line_table *table) {
+    long i;
+    table->entries_capacity = LINE_TABLE_INITIAL_BUCKETS;
+    table->entries_num = 0;
+    table->entries = malloc(table->entries_capacity * sizeof(struct line_entry));
+    table->buckets_num = LINE_TABLE_INITIAL_BUCKETS;
+    table->buckets = malloc(table->buckets_num * sizeof(long));
+    assert(NULL != table->entries && NULL != table->buckets);
+    for (i = 0; i < table->buckets_num; i++) {
+        table->buckets[i] = NO_LINE_ENTRY;
+    }
+}
 
-void generate_line(struct passed_args *args, struct cache_line *ya_line, long tag) {
+static void free_line_table(struct line_table *table) {
+    free(table->entries);
+    free(table->buckets);
+}
+
+static void grow_line_table(struct line_table *table) {
 /*
-    Function to generate and initialize a line of cache set
+    Function to double the number of buckets of the table and to rehash the entries
 */
-    char block_bits_num = get_block_bits_num(args);
-    int number_of_blocks = get_number_of_blocks(block_bits_num);
-    long *bytes = calloc(number_of_blocks, sizeof(long));
-    ya_line->bytes = bytes;
-    ya_line->valid_bit = 0;
-    ya_line->tag = tag;
-    ya_line->age = 0;
+    long i;
+    long bucket;
+    table->buckets_num *= 2;
+    table->buckets = realloc(table->buckets, table->buckets_num * sizeof(long));
+    assert(NULL != table->buckets);
+    for (i = 0; i < table->buckets_num; i++) {
+        table->buckets[i] = NO_LINE_ENTRY;
+    }
+    for (i = 0; i < table->entries_num; i++) {
+        bucket = hash_line_address(table->entries[i].line_address) & (table->buckets_num - 1);
+        table->entries[i].next = table->buckets[bucket];
+        table->buckets[bucket] = i;
+    }
 }
 
-void generate_set(struct passed_args *args, struct set *ya_set, long index) {
+static long find_or_add_line(struct line_table *table, unsigned long line_address, int *is_new) {
 /*
-    Function to generate a cache set
+    Function to get the index of the entry of a line. The entry is added
+    if the line was never accessed before.
 */
-    char number_of_lines = args->associativity_num;
-    struct cache_line *lines = malloc(number_of_lines * sizeof(struct cache_line));
-    int i;
-    ya_set->index = index;
-    ya_set->number_of_lines = number_of_lines;
+    long bucket = hash_line_address(line_address) & (table->buckets_num - 1);
+    long entry_index = table->buckets[bucket];
+    while (NO_LINE_ENTRY != entry_index) {
+        if (table->entries[entry_index].line_address == line_address) {
+            *is_new = 0;
+            return entry_index;
+        }
+        entry_index = table->entries[entry_index].next;
+    }
 
-    /* Generating and initializing lines of cache set  */
-    for (i = 0; i < number_of_lines; i++) {
-        generate_line(args, &lines[i], i);
+    *is_new = 1;
+    if (table->entries_num == table->entries_capacity) {
+        table->entries_capacity *= 2;
+        table->entries = realloc(table->entries,
+                                    table->entries_capacity * sizeof(struct line_entry));
+        assert(NULL != table->entries);
     }
-    ya_set->lines = lines;
+    entry_index = table->entries_num;
+    table->entries_num++;
+    table->entries[entry_index].line_address = line_address;
+    table->entries[entry_index].position = 0;
+    table->entries[entry_index].next = table->buckets[bucket];
+    table->buckets[bucket] = entry_index;
+    if (table->entries_num > table->buckets_num) {
+        grow_line_table(table);
+    }
+    return entry_index;
 }
 
-struct set *generate_sets(struct passed_args *args) {
+static void rebuild_reuse_stack(struct reuse_stack *stack, struct line_entry *entries) {
 /*
-    Function to generate all cache sets
+    Function called when all positions of the stack are used: the marked
+    positions are moved to the beginning and the capacity is adjusted so that
+    at least half of the positions are free again.
 */
-    int number_of_sets = get_number_of_sets(args->set_index_bits_num);
-    struct set *sets = malloc(number_of_sets * sizeof(struct set));
-    int i = 0;
-    for (i = 0; i < number_of_sets; i++) {
-        generate_set(args, &sets[i], i);
+    long new_capacity = 2 * stack->lines_num;
+    long *new_owners;
+    long position;
+    long new_position = 0;
+    long parent;
+    if (new_capacity < REUSE_STACK_INITIAL_CAPACITY) {
+        new_capacity = REUSE_STACK_INITIAL_CAPACITY;
+    }
+    new_owners = malloc(new_capacity * sizeof(long));
+    assert(NULL != new_owners);
+    for (position = 0; position < stack->top; position++) {
+        if (NO_LINE_ENTRY != stack->owners[position]) {
+            new_owners[new_position] = stack->owners[position];
+            entries[new_owners[new_position]].position = new_position;
+            new_position++;
+        }
+    }
+    for (position = new_position; position < new_capacity; position++) {
+        new_owners[position] = NO_LINE_ENTRY;
+    }
+    free(stack->owners);
+    stack->owners = new_owners;
+    stack->top = new_position;
+
+    /* Building the Fenwick tree in linear time */
+    free(stack->tree);
+    stack->tree = calloc(new_capacity + 1, sizeof(unsigned int));
+    assert(NULL != stack->tree);
+    for (position = 1; position <= new_capacity; position++) {
+        if (position <= new_position) {
+            stack->tree[position] += 1;
+        }
+        parent = position + (position & (-position));
+        if (parent <= new_capacity) {
+            stack->tree[parent] += stack->tree[position];
+        }
     }
-    return sets;
+    stack->capacity = new_capacity;
 }
 
-struct cache_model *create_cache_model(struct passed_args *args) {
-/* Main function of the cache model section. Returns cache model, built according to the
-    user's "specifications", given as program arguments. */
-    struct cache_model *cache = malloc(sizeof(struct cache_model));
-    int number_of_sets = get_number_of_sets(args->set_index_bits_num);
-    struct set *sets = generate_sets(args);
-    cache->number_of_sets = number_of_sets;
-    cache->sets = sets;
-    return cache;
+static void count_stack_distance(struct stack_distance_engine *engine, unsigned long distance) {
+    long new_size;
+    if (distance >= (unsigned long)engine->distance_counts_size) {
+        new_size = 2 * engine->distance_counts_size;
+        while ((unsigned long)new_size <= distance) {
+            new_size *= 2;
+        }
+        engine->distance_counts = realloc(engine->distance_counts, new_size * sizeof(unsigned long));
+        assert(NULL != engine->distance_counts);
+        memset(engine->distance_counts + engine->distance_counts_size, 0,
+                (new_size - engine->distance_counts_size) * sizeof(unsigned long));
+        engine->distance_counts_size = new_size;
+    }
+    engine->distance_counts[distance]++;
 }
 
-/* End of the subsection where the functions to generate the cache model
-    are described */
+static void record_stack_distance(struct stack_distance_engine *engine, unsigned long address) {
+/*
+    Main function of the section: computes the stack distance of an access
+*/
+    unsigned long line_address = address >> engine->geometry.block_bits_num;
+    struct reuse_stack *stack = &(engine->stacks[get_set_index(address, engine->decoder)]);
+    int is_new;
+    long entry_index = find_or_add_line(&(engine->table), line_address, &is_new);
+    struct line_entry *entry = &(engine->table.entries[entry_index]);
+    long previous_position;
 
-/* END OF CACHE MODEL SECTION */
+    if (stack->top == stack->capacity) {
+        rebuild_reuse_stack(stack, engine->table.entries);
+    }
+    engine->accesses_num++;
+    if (is_new) {
+        engine->cold_accesses++;
+        stack->lines_num++;
+    } else {
+        /* The distance is the number of lines accessed after the previous access */
+        previous_position = entry->position;
+        count_stack_distance(engine, fenwick_prefix_sum(stack->tree, stack->top)
+                                - fenwick_prefix_sum(stack->tree, previous_position + 1));
+        fenwick_add(stack->tree, stack->capacity, previous_position, -1);
+        stack->owners[previous_position] = NO_LINE_ENTRY;
+    }
+    fenwick_add(stack->tree, stack->capacity, stack->top, 1);
+    stack->owners[stack->top] = entry_index;
+    entry->position = stack->top;
+    stack->top++;
+}
 
+static struct stack_distance_engine *create_stack_distance_engine(struct cache_geometry geometry) {
+    struct stack_distance_engine *engine = malloc(sizeof(struct stack_distance_engine));
+    assert(NULL != engine);
+    engine->geometry = geometry;
+    engine->decoder = create_address_decoder(geometry);
+    init_line_table(&(engine->table));
+    /* Stacks get their memory when they are used for the first time */
+    engine->stacks_num = get_number_of_sets(geometry.set_index_bits_num);
+    engine->stacks = calloc(engine->stacks_num, sizeof(struct reuse_stack));
+    assert(NULL != engine->stacks);
+    engine->distance_counts_size = REUSE_STACK_INITIAL_CAPACITY;
+    engine->distance_counts = calloc(engine->distance_counts_size, sizeof(unsigned long));
+    assert(NULL != engine->distance_counts);
+    engine->cold_accesses = 0;
+    engine->accesses_num = 0;
+    return engine;
+}
 
-/* FILE PARSING SECTION */
+static void destroy_stack_distance_engine(struct stack_distance_engine *engine) {
+    long i;
+    for (i = 0; i < engine->stacks_num; i++) {
+        free(engine->stacks[i].tree);
+        free(engine->stacks[i].owners);
+    }
+    free(engine->stacks);
+    free_line_table(&(engine->table));
+    free(engine->distance_counts);
+    free(engine);
+}
 
-int count_lines_to_regard_internal(FILE *fp) {
-    /* Count number of lines that are to be taken into consideration by csim.
-        That means that the lines starting with 'I' are not counted. */
-    int result = 0;
-    int last_eol = 0;  // used to store information that previously observed char was '\n'
-    char next_char;
+static struct cache_statistics get_lru_statistics(struct stack_distance_engine *engine,
+                                            unsigned long lines_per_set) {
+/*
+    Function to compute the results of a LRU cache with the passed associativity
+    from the stack distances
+*/
+    struct cache_statistics statistics;
+    unsigned long first_fills = 0;  // misses that did not evict anything
+    unsigned long distance;
+    long i;
+    statistics.hits = 0;
+    for (distance = 0; distance < lines_per_set
+            && distance < (unsigned long)engine->distance_counts_size; distance++) {
+        statistics.hits += engine->distance_counts[distance];
+    }
+    statistics.misses = engine->accesses_num - statistics.hits;
+    /* A set evicts nothing until all its lines are used */
+    for (i = 0; i < engine->stacks_num; i++) {
+        if ((unsigned long)engine->stacks[i].lines_num < lines_per_set) {
+            first_fills += engine->stacks[i].lines_num;
+        } else {
+            first_fills += lines_per_set;
+        }
+    }
+    statistics.evictions = statistics.misses - first_fills;
+    return statistics;
+}
+
+static void print_associativity_results(struct stack_distance_engine *engine, char max_associativity) {
+    struct cache_statistics statistics;
+    int E;
+    for (E = 1; E <= max_associativity; E++) {
+        statistics = get_lru_statistics(engine, E);
+        printf("s:%d E:%d b:%d hits:%lu misses:%lu evictions:%lu\n",
+                engine->geometry.set_index_bits_num, E, engine->geometry.block_bits_num,
+                statistics.hits, statistics.misses, statistics.evictions);
+    }
+}
 
-    /* Check if the first line is to be counted */
-    if (!feof(fp)) {
-        next_char = fgetc(fp);
-        if (' ' == next_char) {
-            result++;
+static void print_reuse_curve(struct stack_distance_engine *engine) {
+/*
+    Function to print the results of fully associative caches of 1, 2, 4, ... lines,
+    up to the size where all accessed lines fit in the cache
+*/
+    struct cache_statistics statistics;
+    unsigned long lines_num = 1;
+    while (1) {
+        statistics = get_lru_statistics(engine, lines_num);
+        printf("lines:%lu hits:%lu misses:%lu evictions:%lu\n",
+                lines_num, statistics.hits, statistics.misses, statistics.evictions);
+        if (lines_num >= (unsigned long)engine->stacks[0].lines_num) {
+            break;
         }
+        lines_num *= 2;
+    }
+}
+
+static unsigned long run_stack_distance(struct passed_args *args) {
+/*
+    Main function of the stack distance mode. Returns the number of accesses.
+*/
+    struct stack_distance_engine *set_engine = NULL;
+    struct stack_distance_engine *full_engine = NULL;
+    struct cache_geometry geometry = get_cache_geometry(args);
+    struct trace_reader *reader;
+    struct file_line access;
+    int repeat;
+    unsigned long accesses_count = 0;
+    if (args->stack_distance_max > 0) {
+        set_engine = create_stack_distance_engine(geometry);
+    }
+    if (args->reuse_curve_flag) {
+        /* A fully associative cache has only one set */
+        geometry.set_index_bits_num = 0;
+        full_engine = create_stack_distance_engine(geometry);
     }
 
-    /* Processing the rest of file */
-    while (!feof(fp)) {
-        next_char = fgetc(fp);
-        if (1 == last_eol) {
-            if (' ' == next_char) {
-                result++;
+    reader = open_trace_reader(args->trace_file);
+    while (read_next_access(reader, &access)) {
+        for (repeat = (M == access.operation) ? 2 : 1; repeat > 0; repeat--) {
+            if (NULL != set_engine) {
+                record_stack_distance(set_engine, access.address);
             }
-            last_eol = 0;
-        }
-        if ('\n' == next_char) {
-            last_eol = 1;
+            if (NULL != full_engine) {
+                record_stack_distance(full_engine, access.address);
+            }
+            accesses_count++;
         }
     }
+    close_trace_reader(reader);
 
-    rewind(fp);  // rewinding file to restore the original pointer
-    return result;
+    if (NULL != set_engine) {
+        print_associativity_results(set_engine, args->stack_distance_max);
+        destroy_stack_distance_engine(set_engine);
+    }
+    if (NULL != full_engine) {
+        print_reuse_curve(full_engine);
+        destroy_stack_distance_engine(full_engine);
+    }
+    return accesses_count;
+}
+
+/* END OF STACK DISTANCE SECTION */
+
+
+/* MISS CLASSIFICATION SECTION */
+
+/* A miss is compulsory if the line was never accessed before, a capacity miss
+    if it also misses in a fully associative LRU cache of the same number of
+    lines (the shadow cache), and a conflict miss otherwise.
+    The lines of the shadow cache are entries of a line table, so the table also
+    tells which lines were accessed. The cached entries are linked in a list
+    from the most to the least recently used one, so every access is O(1). */
+
+# define CONFLICT_HOT_SPOTS_NUM 10
+
+struct shadow_cache {
+/*
+    Structure that represents the fully associative LRU shadow cache.
+*/
+    struct line_table table;
+    long *previous;  // entry used just after this one, indexed by entry
+    long *next;  // entry used just before this one, indexed by entry
+    char *is_cached;  // indexed by entry
+    long links_capacity;
+    long most_recent;
+    long least_recent;
+    long lines_num;
+    long capacity;
+};
+
+struct miss_classification {
+    unsigned long compulsory;
+    unsigned long capacity;
+    unsigned long conflict;
+    unsigned long *set_conflicts;  // number of conflict misses of every set
+    long sets_num;
+};
+
+static void init_shadow_cache(struct shadow_cache *shadow, long capacity) {
+    init_line_table(&(shadow->table));
+    shadow->links_capacity = 0;
+    shadow->previous = NULL;
+    shadow->next = NULL;
+    shadow->is_cached = NULL;
+    shadow->most_recent = NO_LINE_ENTRY;
+    shadow->least_recent = NO_LINE_ENTRY;
+    shadow->lines_num = 0;
+    shadow->capacity = capacity;
+}
+
+static void free_shadow_cache(struct shadow_cache *shadow) {
+    free_line_table(&(shadow->table));
+    free(shadow->previous);
+    free(shadow->next);
+    free(shadow->is_cached);
 }
 
-void skip_to_new_line(FILE *fp) {
+static void grow_shadow_links(struct shadow_cache *shadow) {
 /*
-    Function to skip a line of the file
+    Function to give list links to the entries added to the line table
 */
-    char next_char = '1';
-    while (('\n' != next_char) && (EOF != next_char)) {
-        next_char = fgetc(fp);
+    long old_capacity = shadow->links_capacity;
+    shadow->links_capacity = shadow->table.entries_capacity;
+    shadow->previous = realloc(shadow->previous, shadow->links_capacity * sizeof(long));
+    shadow->next = realloc(shadow->next, shadow->links_capacity * sizeof(long));
+    shadow->is_cached = realloc(shadow->is_cached, shadow->links_capacity);
+    assert(NULL != shadow->previous && NULL != shadow->next && NULL != shadow->is_cached);
+    memset(shadow->is_cached + old_capacity, 0, shadow->links_capacity - old_capacity);
+}
+
+static void unlink_shadow_line(struct shadow_cache *shadow, long entry) {
+    if (NO_LINE_ENTRY != shadow->previous[entry]) {
+        shadow->next[shadow->previous[entry]] = shadow->next[entry];
+    } else {
+        shadow->most_recent = shadow->next[entry];
+    }
+    if (NO_LINE_ENTRY != shadow->next[entry]) {
+        shadow->previous[shadow->next[entry]] = shadow->previous[entry];
+    } else {
+        shadow->least_recent = shadow->previous[entry];
+    }
+}
+
+static void link_shadow_line_first(struct shadow_cache *shadow, long entry) {
+    shadow->previous[entry] = NO_LINE_ENTRY;
+    shadow->next[entry] = shadow->most_recent;
+    if (NO_LINE_ENTRY != shadow->most_recent) {
+        shadow->previous[shadow->most_recent] = entry;
+    } else {
+        shadow->least_recent = entry;
     }
+    shadow->most_recent = entry;
 }
 
-enum MemoryAccessOperation get_line_operation(char operation_char) {
+static int access_shadow_cache(struct shadow_cache *shadow, unsigned long line_address, int *is_first_access) {
 /*
-    Function to return the operation with the data described on
-    a line of trace file
+    Function to simulate an access to the shadow cache. Returns 1 on a hit.
+    is_first_access is set if the line was never accessed before.
 */
-    enum MemoryAccessOperation operation;
-    switch (operation_char) {
-        case 'M':
-        case 'm':
-            operation = M;
-            break;
-        case 'L':
-        case 'l':
-            operation = L;
-            break;
-        case 'S':
-        case 's':
-            operation = S;
-            break;
-        default:
-            printf("In the file being parsed an operation '%c' cannot be recognized.\n", operation_char);
-            exit(EXIT_SUCCESS);
-            break;
+    long entry = find_or_add_line(&(shadow->table), line_address, is_first_access);
+    if (shadow->table.entries_capacity > shadow->links_capacity) {
+        grow_shadow_links(shadow);
     }
-    return operation;
+    if (shadow->is_cached[entry]) {
+        unlink_shadow_line(shadow, entry);
+        link_shadow_line_first(shadow, entry);
+        return 1;
+    }
+    if (shadow->lines_num == shadow->capacity) {
+        shadow->is_cached[shadow->least_recent] = 0;
+        unlink_shadow_line(shadow, shadow->least_recent);
+    } else {
+        shadow->lines_num++;
+    }
+    shadow->is_cached[entry] = 1;
+    link_shadow_line_first(shadow, entry);
+    return 0;
 }
 
-/* Functions in this subsection are aimed to check the correctness of addresses
-    given in the trace file and to represent them as numerical values */
+static void classify_access(struct cache_model *cache, struct shadow_cache *shadow,
+                        struct miss_classification *classification,
+                        unsigned long address, struct address_decoder decoder) {
+/*
+    Function to simulate an access in the cache and in the shadow cache
+    and to classify the miss, if any
+*/
+    struct address_separated addr_sep = separate_address(address, decoder);
+    unsigned long misses = cache->statistics.misses;
+    int is_first_access;
+    int shadow_hit;
+    simulate_access(cache, addr_sep.set_index, addr_sep.line_tag);
+    shadow_hit = access_shadow_cache(shadow, address >> decoder.set_index_shift, &is_first_access);
+    if (misses == cache->statistics.misses) {
+        return;
+    }
+    if (is_first_access) {
+        classification->compulsory++;
+    } else if (!shadow_hit) {
+        classification->capacity++;
+    } else {
+        classification->conflict++;
+        classification->set_conflicts[addr_sep.set_index]++;
+    }
+}
+
+struct set_conflicts {
+    long set_index;
+    unsigned long conflicts;
+};
 
-void verify_address_character(char char_to_verify) {
+static int compare_set_conflicts(const void *first, const void *second) {
 /*
-    Function to check if the address given in the trace file 
-    conains only hex characters.
+    Function to sort sets by decreasing number of conflict misses
 */
-    if (!(
-        (char_to_verify >= 48 && char_to_verify <= 57)  // 0..9
-        || (char_to_verify >= 65 && char_to_verify <= 70)  // A..F
-        || (char_to_verify >= 97 && char_to_verify <= 102)  // a..f
-        )) {
-        printf("The file being parsed contains an address that is not a hex value: %c\n", char_to_verify);
-        exit(EXIT_SUCCESS);
-    } 
+    const struct set_conflicts *first_set = first;
+    const struct set_conflicts *second_set = second;
+    if (first_set->conflicts != second_set->conflicts) {
+        return (first_set->conflicts < second_set->conflicts) ? 1 : -1;
+    }
+    return (first_set->set_index > second_set->set_index) ? 1 : -1;
 }
 
-unsigned long hex_to_ulong(char *hex_str) {
+static void print_miss_classification(struct miss_classification *classification) {
 /*
-    Function to convert string representation of the address
-    to a numerical one
+    Function to print the number of misses of each class and the sets
+    with the most conflict misses
 */
-    unsigned long result = strtoul(hex_str, NULL, 16);
-    return result;
+    struct set_conflicts *sets = malloc(classification->sets_num * sizeof(struct set_conflicts));
+    long i;
+    assert(NULL != sets);
+    printf("compulsory:%lu capacity:%lu conflict:%lu\n", classification->compulsory,
+            classification->capacity, classification->conflict);
+    for (i = 0; i < classification->sets_num; i++) {
+        sets[i].set_index = i;
+        sets[i].conflicts = classification->set_conflicts[i];
+    }
+    qsort(sets, classification->sets_num, sizeof(struct set_conflicts), compare_set_conflicts);
+    for (i = 0; i < classification->sets_num && i < CONFLICT_HOT_SPOTS_NUM; i++) {
+        if (0 == sets[i].conflicts) {
+            break;
+        }
+        printf("set:%ld conflict:%lu\n", sets[i].set_index, sets[i].conflicts);
+    }
+    free(sets);
 }
 
-long get_line_address(FILE *fp) {
+static unsigned long run_miss_classification(struct passed_args *args) {
 /*
-    Function to get a numeric representation of the address
-    given on a file string
+    Main function of the miss classification mode. Returns the number of accesses.
 */
-    char next_char;
-    char address_str[9] = {'\0'};
-    int i;
-    unsigned long result = 0; 
-    next_char = fgetc(fp);
-    if (' ' != next_char) {
-        printf("The file being parsed is badly formatted: no space between an operation and an address ('%c' found instead).\n",
-                next_char);
-        exit(EXIT_SUCCESS);
-    }
-    for (i = 0; i < 8; i++) {
-        next_char = fgetc(fp);
-        if (',' == next_char) {
-            break;
+    struct cache_model *cache = create_cache_model(get_cache_geometry(args), get_first_policy(args), args->seed);
+    struct address_decoder decoder = create_address_decoder(get_cache_geometry(args));
+    struct trace_reader *reader = open_trace_reader(args->trace_file);
+    struct shadow_cache shadow;
+    struct miss_classification classification;
+    struct file_line access;
+    unsigned long accesses_count = 0;
+
+    init_shadow_cache(&shadow, (long)cache->number_of_sets * cache->number_of_lines);
+    classification.compulsory = 0;
+    classification.capacity = 0;
+    classification.conflict = 0;
+    classification.sets_num = cache->number_of_sets;
+    classification.set_conflicts = calloc(classification.sets_num, sizeof(unsigned long));
+    assert(NULL != classification.set_conflicts);
+
+    while (read_next_access(reader, &access)) {
+        classify_access(cache, &shadow, &classification, access.address, decoder);
+        accesses_count++;
+        if (M == access.operation) {
+            classify_access(cache, &shadow, &classification, access.address, decoder);
+            accesses_count++;
         }
-        verify_address_character(next_char);
-        address_str[i] = next_char;
     }
-    result = hex_to_ulong(address_str);
-    return result;
+    close_trace_reader(reader);
+
+    printSummary(cache->statistics.hits, cache->statistics.misses, cache->statistics.evictions);
+    print_miss_classification(&classification);
+    free(classification.set_conflicts);
+    free_shadow_cache(&shadow);
+    destroy_cache_model(cache);
+    return accesses_count;
 }
 
-/* End of addresses processing subsection */
+/* END OF MISS CLASSIFICATION SECTION */
+
+
+/* SET SAMPLING SECTION */
+
+/* Only the sets whose hashed index is a multiple of the sample rate are simulated,
+    by a cache model that has these sets only: the trace reader drops the accesses
+    to the other sets as soon as their address is decoded.
+    The totals are extrapolated from the sampled sets, considered as a simple
+    random sample of the sets: with n sets sampled out of N, the total is
+    N times the mean of the sampled sets, and its 95% confidence interval is
+    1.96 * N * sqrt((1 - n / N) * v / n), where v is the variance of the
+    sampled per set counts (the finite population correction 1 - n / N makes
+    the interval vanish when every set is sampled). */
 
-void parse_file_lines(FILE *fp, struct file_line *lines) {
+# define CONFIDENCE_95_QUANTILE 1.96
+
+struct set_sample {
 /*
-    Function to parse the lines of a trace file and fill
-    the passed file_line structure with the results
+    Structure that represents the sampled sets and their results.
 */
-    char next_char;
-    int i = 0;
+    long *sampled_index;  // for every set, its index in the sampled cache or -1
+    long sets_num;
+    long sampled_sets_num;
+    struct cache_statistics *set_statistics;  // results of every sampled set
+};
 
-    while(!feof(fp)) {
-        next_char = fgetc(fp);
-        if (' ' != next_char) {
-        /* If we deal with instruction on the line, 
-            we skip to the next one  */
-            skip_to_new_line(fp);
-            continue;
+static void init_set_sample(struct set_sample *sample, int number_of_sets, unsigned long sample_rate,
+                        unsigned long seed) {
+    long set_index;
+    sample->sets_num = number_of_sets;
+    sample->sampled_sets_num = 0;
+    sample->sampled_index = malloc(number_of_sets * sizeof(long));
+    assert(NULL != sample->sampled_index);
+    for (set_index = 0; set_index < number_of_sets; set_index++) {
+        if (0 == mix_bits(set_index ^ seed) % sample_rate) {
+            sample->sampled_index[set_index] = sample->sampled_sets_num++;
+        } else {
+            sample->sampled_index[set_index] = -1;
         }
+    }
+    if (sample->sampled_sets_num < 2) {
+        printf("Less than 2 sets of %ld are sampled, use a smaller sample rate or another seed\n",
+                sample->sets_num);
+        exit(EXIT_SUCCESS);
+    }
+    sample->set_statistics = calloc(sample->sampled_sets_num, sizeof(struct cache_statistics));
+    assert(NULL != sample->set_statistics);
+}
 
-        /* Reading and storing next line */
-        next_char = fgetc(fp);
-        lines[i].operation = get_line_operation(next_char);
-        lines[i].address = get_line_address(fp);
-        i++;
+static void free_set_sample(struct set_sample *sample) {
+    free(sample->sampled_index);
+    free(sample->set_statistics);
+}
 
-        /* Getting to the next line */
-        skip_to_new_line(fp);
+static void make_sampled_cache_step(unsigned long address, struct cache_model *cache,
+                                struct set_sample *sample, struct address_decoder decoder) {
+/*
+    Function to simulate an access to a sampled set
+*/
+    long set_index = sample->sampled_index[get_set_index(address, decoder)];
+    struct cache_statistics *set_statistics;
+    unsigned long misses_count;
+    unsigned long evictions_count;
+    set_statistics = &(sample->set_statistics[set_index]);
+    misses_count = cache->statistics.misses;
+    evictions_count = cache->statistics.evictions;
+    simulate_access(cache, set_index, get_line_tag(address, decoder));
+    if (misses_count == cache->statistics.misses) {
+        set_statistics->hits += 1;
+    } else {
+        set_statistics->misses += 1;
+        set_statistics->evictions += evictions_count != cache->statistics.evictions;
     }
-    rewind(fp);
 }
 
-int count_lines_to_regard(char *file_name) {
+static void extrapolate_count(struct set_sample *sample, size_t count_offset,
+                        unsigned long *estimate, double *error) {
 /*
-    Function to get the number of lines of the trace file
-    that will be processed by the program. This function is needed
-    to estimate how much memory is to be used to store the trace fle
-    representation.
+    Function to extrapolate the total of a count of the sets (at count_offset
+    in their statistics) and the half width of its 95% confidence interval
 */
-    FILE *fp = fopen(file_name, "r");
-    if (NULL == fp) {
-        printf("Cannot open file %s\n", file_name);
-        exit(EXIT_FAILURE);
+    double sum = 0;
+    double squares_sum = 0;
+    double mean;
+    double variance;
+    double count;
+    double sets_num = sample->sets_num;
+    double sampled_sets_num = sample->sampled_sets_num;
+    long i;
+    for (i = 0; i < sample->sampled_sets_num; i++) {
+        count = *(unsigned long *)((char *)&(sample->set_statistics[i]) + count_offset);
+        sum += count;
+        squares_sum += count * count;
     }
-    int lines_to_regard_count = count_lines_to_regard_internal(fp);
-    fclose(fp);
-    return lines_to_regard_count;
+    mean = sum / sampled_sets_num;
+    variance = (squares_sum - sum * mean) / (sampled_sets_num - 1);
+    if (variance < 0) {
+        variance = 0;  // rounding errors
+    }
+    *estimate = (unsigned long)(mean * sets_num + 0.5);
+    *error = CONFIDENCE_95_QUANTILE * sets_num
+                * sqrt((1 - sampled_sets_num / sets_num) * variance / sampled_sets_num);
 }
 
-struct file_line *process_trace_file(char *file_name, int lines_to_regard_count) {
+static unsigned long run_set_sampling(struct passed_args *args) {
 /*
-    Main fuction to process a trace file
+    Main function of the set sampling mode. Returns the number of accesses
+    of the trace (simulated or not).
 */
-    FILE *fp = fopen(file_name, "r");
-    struct file_line *file_representation;
-    if (NULL == fp) {
-        printf("Cannot open file %s\n", file_name);
-        exit(EXIT_FAILURE);
+    struct cache_geometry geometry = get_cache_geometry(args);
+    struct address_decoder decoder = create_address_decoder(geometry);
+    struct trace_reader *reader;
+    struct set_sample sample;
+    struct cache_model *cache;
+    struct cache_statistics statistics;
+    struct file_line access;
+    double hits_error, misses_error, evictions_error;
+    unsigned long accesses_count = 0;
+
+    init_set_sample(&sample, get_number_of_sets(geometry.set_index_bits_num),
+                    args->sample_rate, args->seed);
+    cache = allocate_cache_model(sample.sampled_sets_num, geometry.associativity_num,
+                                    get_first_policy(args), args->seed);
+    cache->line_size = two_to_pow(geometry.block_bits_num);
+
+    reader = open_trace_reader(args->trace_file);
+    reader->set_filter = sample.sampled_index;
+    reader->filter_decoder = decoder;
+    while (read_next_access(reader, &access)) {
+        make_sampled_cache_step(access.address, cache, &sample, decoder);
+        accesses_count++;
+        if (M == access.operation) {
+            make_sampled_cache_step(access.address, cache, &sample, decoder);
+            accesses_count++;
+        }
     }
-    file_representation = malloc(lines_to_regard_count * sizeof(struct file_line));
-    parse_file_lines(fp, file_representation);
-    fclose(fp);
-    return file_representation;
+    accesses_count += reader->filtered_accesses_num;
+    close_trace_reader(reader);
+
+    extrapolate_count(&sample, offsetof(struct cache_statistics, hits),
+                        &(statistics.hits), &hits_error);
+    extrapolate_count(&sample, offsetof(struct cache_statistics, misses),
+                        &(statistics.misses), &misses_error);
+    extrapolate_count(&sample, offsetof(struct cache_statistics, evictions),
+                        &(statistics.evictions), &evictions_error);
+    printSummary(statistics.hits, statistics.misses, statistics.evictions);
+    printf("sampled_sets:%ld/%ld hits:+-%.0f misses:+-%.0f evictions:+-%.0f (95%% confidence)\n",
+            sample.sampled_sets_num, sample.sets_num, hits_error, misses_error, evictions_error);
+    free_set_sample(&sample);
+    destroy_cache_model(cache);
+    return accesses_count;
 }
 
-/* END OF FILE PARSING SECTION */
+/* END OF SET SAMPLING SECTION */
 
 
-/* ADDRESS COMPUTING SECTION */
+/* HIERARCHY SECTION */
 
-unsigned int generate_addr_mask(int left_offset, int right_offset) {
-/* 
-    Function for mask generation. 
-    left_offset - number of zero most significant bits in the mask.
-    right_offset - number of zero least significant bits in the mask. 
+struct hierarchy_level {
+/*
+    Structure that represents a level of the cache hierarchy.
 */
-    unsigned int right_mask = 1;
-    unsigned int mask = 1;
-    
-    /* Several checkings of variable boundaries.  */
-    if (left_offset >= ADDRESS_BIT_LENGTH) {
-        mask = 0;  // all 1's 
-        return mask;
-    }
-    if (left_offset <= 0) {
-        left_offset = 0;
-        mask = 4294967295;
-    }
-    if (right_offset >= ADDRESS_BIT_LENGTH) {
-        mask = 0;
-        return mask;
-    }
-    if (right_offset < 0) {
-        right_offset = 0;
+    struct cache_geometry geometry;
+    struct address_decoder decoder;
+    struct cache_model *cache;
+    unsigned long back_invalidations;  // lines removed to keep an inclusive hierarchy inclusive
+};
+
+struct cache_hierarchy {
+/*
+    Structure that represents the whole cache hierarchy, levels[0] is L1.
+*/
+    struct hierarchy_level *levels;
+    int levels_num;
+    enum InclusionPolicy inclusion;
+};
+
+static struct cache_hierarchy *create_cache_hierarchy(struct passed_args *args) {
+    struct cache_hierarchy *hierarchy = malloc(sizeof(struct cache_hierarchy));
+    struct hierarchy_level *level;
+    int i;
+    assert(NULL != hierarchy);
+    hierarchy->levels_num = args->levels_num;
+    hierarchy->inclusion = args->inclusion;
+    hierarchy->levels = malloc(hierarchy->levels_num * sizeof(struct hierarchy_level));
+    assert(NULL != hierarchy->levels);
+    for (i = 0; i < hierarchy->levels_num; i++) {
+        level = &(hierarchy->levels[i]);
+        level->geometry = args->levels[i].geometry;
+        level->decoder = create_address_decoder(level->geometry);
+        level->cache = create_cache_model(level->geometry, args->levels[i].policy, args->seed);
+        level->back_invalidations = 0;
     }
-    
-    /* Case when the mask offsets overlap */
-    if (right_offset > (ADDRESS_BIT_LENGTH - left_offset)) return 0;
+    return hierarchy;
+}
 
-    right_mask = (right_mask << right_offset) - 1;
-    /* Generating mask without considering the right offset */
-    if (left_offset != 0) {
-        mask = (mask << (ADDRESS_BIT_LENGTH - left_offset)) - 1;
+static void destroy_cache_hierarchy(struct cache_hierarchy *hierarchy) {
+    int i;
+    for (i = 0; i < hierarchy->levels_num; i++) {
+        destroy_cache_model(hierarchy->levels[i].cache);
     }
-    /* Now we consider the right offset */
-    mask = mask - right_mask;
-    return mask;
+    free(hierarchy->levels);
+    free(hierarchy);
 }
 
-unsigned int generate_set_index_mask(struct passed_args *args) {
-/* 
-    Generate mask for set index extraction.
+static int lookup_level(struct hierarchy_level *level, unsigned long address) {
+/*
+    Function to look for an address in a level, the statistics of the level are updated.
+    Returns 1 on a hit.
 */
-    char set_bits_num = get_set_bits_num(args);
-    char block_bits_num = get_block_bits_num(args);
-    char tag_bits_num = ADDRESS_BIT_LENGTH - set_bits_num - block_bits_num;
-    unsigned int mask = generate_addr_mask(tag_bits_num, block_bits_num);
-    return mask;
+    struct address_separated addr_sep = separate_address(address, level->decoder);
+    level->cache->clock += 1;
+    if (check_validity(level->cache, addr_sep.set_index, addr_sep.line_tag)) {
+        level->cache->statistics.hits += 1;
+        return 1;
+    }
+    level->cache->statistics.misses += 1;
+    return 0;
 }
 
-unsigned int generate_block_offset_mask(struct passed_args *args) {
+static int fill_level(struct hierarchy_level *level, unsigned long address, unsigned long *evicted_address) {
 /*
-    Generate mask for block offset value extraction.
+    Function to add the line of an address to a level.
+    Returns 1 if a line was evicted, its address is stored at evicted_address.
 */
-    char block_bits_num = get_block_bits_num(args);
-    char left_offset_mask = ADDRESS_BIT_LENGTH - block_bits_num;
-    unsigned int mask = generate_addr_mask(left_offset_mask, 0);
-    return mask;
+    struct address_separated addr_sep = separate_address(address, level->decoder);
+    unsigned long evicted_tag;
+    if (!add_to_set(level->cache, addr_sep.set_index, addr_sep.line_tag, &evicted_tag)) {
+        return 0;
+    }
+    level->cache->statistics.evictions += 1;
+    *evicted_address = join_address(addr_sep.set_index, evicted_tag, level->decoder);
+    return 1;
 }
 
-unsigned int generate_tag_mask(struct passed_args *args) {
+static void back_invalidate(struct cache_hierarchy *hierarchy, int level_index, unsigned long evicted_address) {
 /*
-    Generate mask for line tag extraction.
+    Function to remove a line evicted from a level from all the levels above,
+    so that they stay included in it
 */
-    char set_bits_num = get_set_bits_num(args);
-    char block_bits_num = get_block_bits_num(args);
-    unsigned int mask = generate_addr_mask(0, set_bits_num + block_bits_num);
-    return mask;
+    struct hierarchy_level *evicting_level = &(hierarchy->levels[level_index]);
+    struct hierarchy_level *level;
+    struct address_separated addr_sep;
+    unsigned long sublines_num;
+    unsigned long j;
+    int i;
+    for (i = 0; i < level_index; i++) {
+        level = &(hierarchy->levels[i]);
+        /* The evicted line may cover several (smaller) lines of the level */
+        sublines_num = 1UL << (evicting_level->geometry.block_bits_num
+                                - level->geometry.block_bits_num);
+        for (j = 0; j < sublines_num; j++) {
+            addr_sep = separate_address(evicted_address + (j << level->geometry.block_bits_num),
+                                        level->decoder);
+            level->back_invalidations += invalidate_line(level->cache, addr_sep.set_index,
+                                                            addr_sep.line_tag);
+        }
+    }
 }
 
-long get_set_index(long address, struct passed_args *args) {
+static void access_inclusive_hierarchy(struct cache_hierarchy *hierarchy, unsigned long address) {
 /*
-    A function to extract the set index from an address
+    Function to simulate an access in an inclusive or a NINE hierarchy: the line
+    is looked for from L1 down and is filled in all the levels where it missed
 */
-    long set_index;
-    char shift_value = get_block_bits_num(args);
-    if (NULL == set_index_mask) {
-        set_index_mask = malloc(sizeof(unsigned int));
-        *set_index_mask = generate_set_index_mask(args);
+    unsigned long evicted_address;
+    int hit_level = 0;
+    int i;
+    while (hit_level < hierarchy->levels_num
+            && !lookup_level(&(hierarchy->levels[hit_level]), address)) {
+        hit_level++;
+    }
+    /* Lower levels are filled first, so that their evictions
+        do not remove the line from the levels above */
+    for (i = hit_level - 1; i >= 0; i--) {
+        if (fill_level(&(hierarchy->levels[i]), address, &evicted_address)
+                && INCLUSIVE == hierarchy->inclusion) {
+            back_invalidate(hierarchy, i, evicted_address);
+        }
     }
-    set_index = (address & (*set_index_mask)) >> shift_value;
-    return set_index;
 }
 
-long get_line_tag(long address, struct passed_args *args) {
+static void access_exclusive_hierarchy(struct cache_hierarchy *hierarchy, unsigned long address) {
 /*
-    A function to extract the line tag from an address
+    Function to simulate an access in an exclusive hierarchy: a line hit in a lower
+    level moves to L1, and lines evicted from a level move to the level below
 */
-    int line_tag;
-    char block_bits_num = get_block_bits_num(args);
-    char set_index_bits = get_set_bits_num(args);
-    char shift_value = block_bits_num + set_index_bits;
-    if (NULL == line_tag_mask) {
-        line_tag_mask = malloc(sizeof(unsigned int));
-        *line_tag_mask = generate_tag_mask(args);
+    struct hierarchy_level *level;
+    struct address_separated addr_sep;
+    unsigned long moved_address = address;
+    int i;
+    for (i = 0; i < hierarchy->levels_num; i++) {
+        level = &(hierarchy->levels[i]);
+        if (lookup_level(level, address)) {
+            if (0 == i) {
+                return;
+            }
+            addr_sep = separate_address(address, level->decoder);
+            invalidate_line(level->cache, addr_sep.set_index, addr_sep.line_tag);
+            break;
+        }
+    }
+    /* The line goes to L1 and the victims go one level down */
+    for (i = 0; i < hierarchy->levels_num; i++) {
+        if (!fill_level(&(hierarchy->levels[i]), moved_address, &moved_address)) {
+            break;
+        }
+    }
+}
+
+static void access_hierarchy(struct cache_hierarchy *hierarchy, unsigned long address) {
+    if (EXCLUSIVE == hierarchy->inclusion) {
+        access_exclusive_hierarchy(hierarchy, address);
+    } else {
+        access_inclusive_hierarchy(hierarchy, address);
     }
-    line_tag = (address & (*line_tag_mask)) >> shift_value;
-    return line_tag;
 }
 
-long get_offset(long address, struct passed_args *args) {
+static void print_hierarchy_results(struct cache_hierarchy *hierarchy, struct passed_args *args) {
 /*
-    A function to extract the block offset from an address
+    Function to print the statistics of every level and the average memory access time
 */
-    int offset;
-    if (NULL == block_offset_mask) {
-        block_offset_mask = malloc(sizeof(unsigned int));
-        *block_offset_mask = generate_block_offset_mask(args);
+    struct hierarchy_level *level;
+    struct cache_statistics statistics = {0, 0, 0};
+    double cycles = 0;
+    unsigned long level_accesses;
+    int i;
+    for (i = 0; i < hierarchy->levels_num; i++) {
+        level = &(hierarchy->levels[i]);
+        statistics = level->cache->statistics;
+        printf("L%d s:%d E:%d b:%d policy:%s hits:%lu misses:%lu evictions:%lu",
+                i + 1, level->geometry.set_index_bits_num, level->geometry.associativity_num,
+                level->geometry.block_bits_num, level->cache->policy->name,
+                statistics.hits, statistics.misses, statistics.evictions);
+        if (INCLUSIVE == hierarchy->inclusion) {
+            printf(" back_invalidations:%lu", level->back_invalidations);
+        }
+        printf("\n");
+        level_accesses = statistics.hits + statistics.misses;
+        if (args->latencies_num > 0) {
+            cycles += (double)level_accesses * args->latencies[i];
+        }
+    }
+    if (args->latencies_num > 0) {
+        /* Misses of the last level go to the memory */
+        cycles += (double)statistics.misses * args->latencies[hierarchy->levels_num];
+        level_accesses = hierarchy->levels[0].cache->statistics.hits
+                            + hierarchy->levels[0].cache->statistics.misses;
+        printf("AMAT:%.2f cycles\n", (level_accesses > 0) ? cycles / level_accesses : 0);
     }
-    offset = address & (*block_offset_mask);
-    return offset;
 }
 
-struct address_separated *separate_address(long address, struct passed_args *args) {
+static unsigned long run_hierarchy(struct passed_args *args) {
 /*
-    A function to separate an address into a set index, line tag and block offset parts
+    Main function of the hierarchy mode. Returns the number of accesses.
 */
-    struct address_separated *separated_address = malloc(sizeof(struct address_separated));
-    separated_address->set_index = get_set_index(address, args);
-    separated_address->line_index = get_line_tag(address, args);
-    separated_address->block_offset = get_offset(address, args);
-    return separated_address;
+    struct cache_hierarchy *hierarchy = create_cache_hierarchy(args);
+    struct trace_reader *reader = open_trace_reader(args->trace_file);
+    struct file_line access;
+    unsigned long accesses_count = 0;
+    while (read_next_access(reader, &access)) {
+        access_hierarchy(hierarchy, access.address);
+        accesses_count++;
+        if (M == access.operation) {
+            access_hierarchy(hierarchy, access.address);
+            accesses_count++;
+        }
+    }
+    close_trace_reader(reader);
+    print_hierarchy_results(hierarchy, args);
+    destroy_cache_hierarchy(hierarchy);
+    return accesses_count;
 }
 
-/* END OF ADDRESS COMPUTING SECTION */
+/* END OF HIERARCHY SECTION */
 
 
-/* CACHE MANIPULATION SECTION  */
+/* MULTICORE SECTION */
+
+/* Every trace is run by a core with a private cache, the caches are kept
+    coherent with the MESI protocol. Valgrind traces have no timestamps, so the
+    cores execute one line of their traces in turn.
+    A line is Modified if its dirty bit is set, Exclusive if its bit of
+    exclusive_lines is set, Shared otherwise and Invalid if it is not valid.
+    For every line, the bytes each core accessed since it got its copy are kept:
+    an invalidation is due to false sharing if the write that caused it does not
+    touch any of these bytes. A bit of the masks covers 1 byte of lines of up to
+    64 bytes and several bytes of bigger lines. */
 
-/* Group of "aging" functions.
-    Used to implement the "Least Recently Used" policy. */
-void age_line(struct cache_line *line) {
+# define FALSE_SHARING_LINES_NUM 10
+
+struct core {
+    struct cache_model *cache;
+    struct trace_reader *reader;
+    unsigned long long *exclusive_lines;  // one mask per set
+    unsigned long accesses_count;
+    int finished;
+};
+
+struct shared_line_statistics {
+    unsigned long invalidations;
+    unsigned long false_sharing;  // invalidations due to false sharing
+};
+
+struct coherence_statistics {
+    unsigned long invalidations;  // copies removed from the other caches by writes
+    unsigned long upgrades;  // writes to a Shared line
+    unsigned long flushes;  // Modified lines written back when another core accesses them
+    unsigned long false_sharing;
+};
+
+struct multicore_system {
 /*
-    Function to increment the age of a line of set chache
+    Structure that represents the cores and the state of the shared lines.
 */
-    line->age += 1;
+    struct core *cores;
+    int cores_num;
+    struct address_decoder decoder;
+    unsigned long line_size;
+    int byte_mask_shift;  // number of bits of a byte offset ignored in the masks
+    struct line_table lines;
+    unsigned long long *accessed_bytes;  // cores_num masks per entry of the line table
+    struct shared_line_statistics *line_statistics;  // indexed by entry
+    long lines_capacity;
+    struct coherence_statistics statistics;
+};
+
+static struct multicore_system *create_multicore_system(struct passed_args *args) {
+    struct multicore_system *system = malloc(sizeof(struct multicore_system));
+    struct cache_geometry geometry = get_cache_geometry(args);
+    struct core *core;
+    int i;
+    assert(NULL != system);
+    system->cores_num = args->trace_files_num;
+    system->cores = malloc(system->cores_num * sizeof(struct core));
+    assert(NULL != system->cores);
+    for (i = 0; i < system->cores_num; i++) {
+        core = &(system->cores[i]);
+        core->cache = create_cache_model(geometry, get_first_policy(args), args->seed);
+        allocate_dirty_lines(core->cache);
+        core->reader = open_trace_reader(args->trace_files[i]);
+        core->exclusive_lines = calloc(core->cache->number_of_sets, sizeof(unsigned long long));
+        assert(NULL != core->exclusive_lines);
+        core->accesses_count = 0;
+        core->finished = 0;
+    }
+    system->decoder = create_address_decoder(geometry);
+    system->line_size = two_to_pow(geometry.block_bits_num);
+    system->byte_mask_shift = (geometry.block_bits_num > 6) ? geometry.block_bits_num - 6 : 0;
+    init_line_table(&(system->lines));
+    system->accessed_bytes = NULL;
+    system->line_statistics = NULL;
+    system->lines_capacity = 0;
+    memset(&(system->statistics), 0, sizeof(struct coherence_statistics));
+    return system;
+}
+
+static void destroy_multicore_system(struct multicore_system *system) {
+    int i;
+    for (i = 0; i < system->cores_num; i++) {
+        destroy_cache_model(system->cores[i].cache);
+        close_trace_reader(system->cores[i].reader);
+        free(system->cores[i].exclusive_lines);
+    }
+    free(system->cores);
+    free_line_table(&(system->lines));
+    free(system->accessed_bytes);
+    free(system->line_statistics);
+    free(system);
 }
 
-void age_lines(struct set *current_set) {
+static long get_shared_line(struct multicore_system *system, unsigned long line_address) {
 /*
-    A function to increment the ages of all lines in the passed set cache.
-    Lines that do are not used for data caching are not considered.
+    Function to get the entry of a line, the per line arrays grow with the table
 */
-    int number_of_lines = current_set->number_of_lines;
-    int i;
-    struct cache_line *current_line;
-    for (i = 0; i < number_of_lines; i++) {
-        current_line = &(current_set->lines[i]);
-        /* As the concept of age is used to implement
-            the LRU Cache policy, we consider only lines
-            that cache data */
-        if (1 == current_line->valid_bit) {
-            age_line(current_line);
-        }
+    int is_new;
+    long entry = find_or_add_line(&(system->lines), line_address, &is_new);
+    long old_capacity = system->lines_capacity;
+    if (system->lines.entries_capacity > system->lines_capacity) {
+        system->lines_capacity = system->lines.entries_capacity;
+        system->accessed_bytes = realloc(system->accessed_bytes, system->lines_capacity
+                                            * system->cores_num * sizeof(unsigned long long));
+        system->line_statistics = realloc(system->line_statistics, system->lines_capacity
+                                            * sizeof(struct shared_line_statistics));
+        assert(NULL != system->accessed_bytes && NULL != system->line_statistics);
+        memset(system->accessed_bytes + old_capacity * system->cores_num, 0,
+                (system->lines_capacity - old_capacity) * system->cores_num
+                * sizeof(unsigned long long));
+        memset(system->line_statistics + old_capacity, 0, (system->lines_capacity - old_capacity)
+                                                    * sizeof(struct shared_line_statistics));
     }
+    return entry;
 }
 
-void age_cache(struct cache_model *cache) {
+static unsigned long long get_byte_mask(struct multicore_system *system, unsigned long address,
+                                    unsigned int size) {
 /*
-    Main function to increment the age of all suitablie lines of the cache
+    Function to get the mask of the bytes of its line an access touches
+    (the part of an access crossing the end of the line is ignored)
 */
-    int number_of_sets = cache->number_of_sets;
-    int i;
-    for (i = 0; i < number_of_sets; i++) {
-        age_lines(&(cache->sets[i]));
+    unsigned long offset = address & (system->line_size - 1);
+    unsigned long last_byte = offset + ((size > 0) ? size : 1) - 1;
+    int first_bit;
+    int bits_num;
+    if (last_byte >= system->line_size) {
+        last_byte = system->line_size - 1;
+    }
+    first_bit = offset >> system->byte_mask_shift;
+    bits_num = (last_byte >> system->byte_mask_shift) - first_bit + 1;
+    if (64 == bits_num) {
+        return ~0ULL;
     }
+    return ((1ULL << bits_num) - 1) << first_bit;
 }
 
-struct cache_line *get_lru_line(struct cache_line *lines_of_set, int number_of_lines,
-                                int line_age[]) {
+static int lookup_core_line(struct cache_model *cache, long set_index, long line_tag) {
 /*
-    Function to choose a line in a set of cache lines according to the
-    LRU cache policy
+    Function to look for a line in the cache of a core, the statistics are updated.
+    Returns the index of the line or -1 on a miss.
 */
-    int max_age = 0;
-    int current_age;
-    struct cache_line current_line;
-    int lru_index = 0;
-    int i;
-    for(i = 0; i < number_of_lines; i++) {
-        current_line = lines_of_set[i];
-        current_age = current_line.age;
-        if (current_age > max_age) {
-            max_age = current_age;
-            lru_index = i;
-        }
+    int line_index;
+    cache->clock += 1;
+    line_index = find_line(cache, set_index, line_tag);
+    if (-1 == line_index) {
+        cache->statistics.misses += 1;
+        return -1;
     }
-    cache_evictions += 1;  // global variable
-    return &(lines_of_set[lru_index]);
+    cache->statistics.hits += 1;
+    cache->policy->on_hit(cache, set_index, line_index);
+    return line_index;
 }
 
-int is_usable(struct cache_line *line) {
+static int fill_core_line(struct core *core, long set_index, long line_tag, int is_exclusive) {
 /*
-    Function to checl if the passed line is not storing any cache data
-    and, therfore, can be used to store some
+    Function to add a line to the cache of a core. Returns the index of the line.
 */
-    if (line->valid_bit) {
-    /* If valid bit is set, than this line is occupied,
-        hence it my not be used directly */
-        return 0;
+    unsigned long evicted_tag;
+    int line_index;
+    if (add_to_set(core->cache, set_index, line_tag, &evicted_tag)) {
+        core->cache->statistics.evictions += 1;
     }
-    return 1;
+    line_index = find_line(core->cache, set_index, line_tag);
+    if (is_exclusive) {
+        core->exclusive_lines[set_index] |= 1ULL << line_index;
+    } else {
+        core->exclusive_lines[set_index] &= ~(1ULL << line_index);
+    }
+    return line_index;
 }
 
-struct cache_line *get_line_to_use(struct set *set_to_observe) {
+static int share_line(struct multicore_system *system, int core_index, long set_index, long line_tag) {
 /*
-    Main function for choosing a line that will be used for storing
-    another portion of data
+    Function to move the copies of a line read by a core to the Shared state.
+    Returns 1 if another core has a copy.
 */
-    int number_of_lines = set_to_observe->number_of_lines;
-    int *line_age = calloc(number_of_lines, sizeof(int));
+    struct core *core;
+    int shared = 0;
+    int line_index;
     int i;
-    struct cache_line *current_line;
-    struct cache_line *result_line;
-    for (i = 0; i < number_of_lines; i++) {
-        current_line = &(set_to_observe->lines[i]);
-        if (is_usable(current_line)) {
-            return current_line;
+    for (i = 0; i < system->cores_num; i++) {
+        core = &(system->cores[i]);
+        line_index = (i == core_index) ? -1 : find_line(core->cache, set_index, line_tag);
+        if (-1 == line_index) {
+            continue;
+        }
+        shared = 1;
+        if (core->cache->dirty_lines[set_index] & (1ULL << line_index)) {
+            core->cache->dirty_lines[set_index] &= ~(1ULL << line_index);
+            system->statistics.flushes += 1;
         }
-        line_age[i] = current_line->age;
+        core->exclusive_lines[set_index] &= ~(1ULL << line_index);
     }
-    /* If we are here no usable line was found.
-    We will be using the "LRU" cache policy. */
-    result_line = get_lru_line(set_to_observe->lines, number_of_lines, line_age);
-    free(line_age);
-    return result_line;
+    return shared;
 }
 
-void add_to_set(struct set *set_to_use, struct address_separated *addr_sep, long int address) {
+static void invalidate_copies(struct multicore_system *system, int core_index, long set_index,
+                        long line_tag, long entry, unsigned long long written_bytes) {
 /*
-    Function that stimulates the process of adding data stored at the passed address
-    to a passed set of the cache
+    Function to remove the copies of a line written by a core from the other caches
 */
-    struct cache_line *line_to_use = get_line_to_use(set_to_use);
-    line_to_use->tag = addr_sep->line_index;
-    line_to_use->age = 1;
-    line_to_use->valid_bit = 1;
+    struct core *core;
+    unsigned long long *accessed_bytes = &(system->accessed_bytes[entry * system->cores_num]);
+    int line_index;
+    int i;
+    for (i = 0; i < system->cores_num; i++) {
+        core = &(system->cores[i]);
+        line_index = (i == core_index) ? -1 : find_line(core->cache, set_index, line_tag);
+        if (-1 == line_index) {
+            continue;
+        }
+        if (core->cache->dirty_lines[set_index] & (1ULL << line_index)) {
+            system->statistics.flushes += 1;
+        }
+        core->exclusive_lines[set_index] &= ~(1ULL << line_index);
+        invalidate_line(core->cache, set_index, line_tag);
+        system->statistics.invalidations += 1;
+        system->line_statistics[entry].invalidations += 1;
+        if (0 == (accessed_bytes[i] & written_bytes)) {
+            system->statistics.false_sharing += 1;
+            system->line_statistics[entry].false_sharing += 1;
+        }
+        accessed_bytes[i] = 0;
+    }
 }
 
-void add_to_cache(long int address, struct cache_model *cache, struct passed_args *args) {
+static void access_coherent_line(struct multicore_system *system, int core_index,
+                            struct file_line *access, int is_write) {
 /*
-    A main function to stimulate the process of adding data (stored at the passed address) to cache
+    Function to simulate a read or a write of a core with the MESI protocol
 */
-    struct address_separated *addr_sep = separate_address(address, args);
-    long set_index = addr_sep->set_index;
-    struct set *set_to_use = &(cache->sets[set_index]);
-    add_to_set(set_to_use, addr_sep, address);
-    free(addr_sep);
+    struct core *core = &(system->cores[core_index]);
+    struct cache_model *cache = core->cache;
+    struct address_separated addr_sep = separate_address(access->address, system->decoder);
+    long entry = get_shared_line(system, access->address >> system->decoder.set_index_shift);
+    unsigned long long bytes = get_byte_mask(system, access->address, access->size);
+    unsigned long long line_bit;
+    int line_index = lookup_core_line(cache, addr_sep.set_index, addr_sep.line_tag);
+    core->accesses_count++;
+    /* The copy brought by a miss starts with no touched bytes: the bytes of a copy
+        lost to an eviction do not make a later invalidation a true sharing one */
+    if (-1 == line_index) {
+        system->accessed_bytes[entry * system->cores_num + core_index] = 0;
+    }
+    if (!is_write) {
+        if (-1 == line_index) {
+            /* The line is Exclusive if no other core has a copy */
+            fill_core_line(core, addr_sep.set_index, addr_sep.line_tag,
+                            !share_line(system, core_index, addr_sep.set_index, addr_sep.line_tag));
+        }
+    } else {
+        if (-1 == line_index) {
+            /* Read for ownership */
+            invalidate_copies(system, core_index, addr_sep.set_index, addr_sep.line_tag,
+                                entry, bytes);
+            line_index = fill_core_line(core, addr_sep.set_index, addr_sep.line_tag, 0);
+        } else {
+            line_bit = 1ULL << line_index;
+            if (!(cache->dirty_lines[addr_sep.set_index] & line_bit)
+                    && !(core->exclusive_lines[addr_sep.set_index] & line_bit)) {
+                system->statistics.upgrades += 1;
+                invalidate_copies(system, core_index, addr_sep.set_index, addr_sep.line_tag,
+                                    entry, bytes);
+            }
+        }
+        /* Exclusive and Shared lines become Modified */
+        cache->dirty_lines[addr_sep.set_index] |= 1ULL << line_index;
+        core->exclusive_lines[addr_sep.set_index] &= ~(1ULL << line_index);
+    }
+    system->accessed_bytes[entry * system->cores_num + core_index] |= bytes;
+}
+
+static int compare_shared_lines(const void *first, const void *second, void *system_arg) {
+    struct multicore_system *system = system_arg;
+    const struct shared_line_statistics *first_line = &(system->line_statistics[*(const long *)first]);
+    const struct shared_line_statistics *second_line = &(system->line_statistics[*(const long *)second]);
+    if (first_line->false_sharing != second_line->false_sharing) {
+        return (first_line->false_sharing < second_line->false_sharing) ? 1 : -1;
+    }
+    return (*(const long *)first > *(const long *)second) ? 1 : -1;
 }
 
-void nullify_age(struct cache_model *cache, long set_index, long line_index) {
+static void print_multicore_results(struct multicore_system *system) {
 /*
-    Function to reset the age of a passed line after the data that is "stored"
-    at its location was accessed (for the LRU cache policy)
+    Function to print the statistics of every core, of the coherence protocol
+    and the lines with the most invalidations due to false sharing
 */
-    struct set *set_to_process = &(cache->sets[set_index]);
-    struct cache_line *line_to_process = &(set_to_process->lines[line_index]);
-    line_to_process->age = 1;
+    struct cache_statistics statistics;
+    long *lines = malloc((system->lines.entries_num + 1) * sizeof(long));
+    long lines_num = 0;
+    long i;
+    assert(NULL != lines);
+    for (i = 0; i < system->cores_num; i++) {
+        statistics = system->cores[i].cache->statistics;
+        printf("core:%ld hits:%lu misses:%lu evictions:%lu\n",
+                i, statistics.hits, statistics.misses, statistics.evictions);
+    }
+    printf("invalidations:%lu upgrades:%lu flushes:%lu false_sharing:%lu\n",
+            system->statistics.invalidations, system->statistics.upgrades,
+            system->statistics.flushes, system->statistics.false_sharing);
+    for (i = 0; i < system->lines.entries_num; i++) {
+        if (system->line_statistics[i].false_sharing > 0) {
+            lines[lines_num++] = i;
+        }
+    }
+    qsort_r(lines, lines_num, sizeof(long), compare_shared_lines, system);
+    for (i = 0; i < lines_num && i < FALSE_SHARING_LINES_NUM; i++) {
+        printf("line:0x%lx invalidations:%lu false_sharing:%lu\n",
+                system->lines.entries[lines[i]].line_address << system->decoder.set_index_shift,
+                system->line_statistics[lines[i]].invalidations,
+                system->line_statistics[lines[i]].false_sharing);
+    }
+    free(lines);
 }
 
-int check_validity(struct cache_model *cache, long set_index, long line_tag) {
+static unsigned long run_multicore(struct passed_args *args) {
 /*
-    Function to check if the data stored at the given address is in the cache
-    (interal)
+    Main function of the multicore mode. Returns the number of accesses.
 */
-    struct set *set_to_observe = &(cache->sets[set_index]);
-    int number_of_lines = set_to_observe->number_of_lines;
-    struct cache_line *set_lines = set_to_observe->lines;
+    struct multicore_system *system = create_multicore_system(args);
+    struct core *core;
+    struct file_line access;
+    unsigned long accesses_count = 0;
+    int cores_running = system->cores_num;
     int i;
-    int found_line_index = -1;
-    long current_line_tag;
-    int current_line_valid_bit;
-    for (i = 0; i < number_of_lines; i++) {
-        current_line_tag = set_lines[i].tag;
-        current_line_valid_bit = set_lines[i].valid_bit;
-        if (current_line_valid_bit && current_line_tag == line_tag) {
-            found_line_index = i;
-            break;
+    while (cores_running > 0) {
+        for (i = 0; i < system->cores_num; i++) {
+            core = &(system->cores[i]);
+            if (core->finished) {
+                continue;
+            }
+            if (!read_next_access(core->reader, &access)) {
+                core->finished = 1;
+                cores_running--;
+                continue;
+            }
+            access_coherent_line(system, i, &access, S == access.operation);
+            accesses_count++;
+            if (M == access.operation) {
+                access_coherent_line(system, i, &access, 1);
+                accesses_count++;
+            }
         }
     }
-    if (-1 == found_line_index) {
-        return 0;
+    print_multicore_results(system);
+    destroy_multicore_system(system);
+    return accesses_count;
+}
+
+/* END OF MULTICORE SECTION */
+
+#endif  // CSIM_LIBRARY
+
+
+/* LIBRARY SECTION */
+
+/* Functions of the embeddable interface described in csim.h. They use
+    the same cache model as the command line tool and keep all their state
+    in the csim_cache structure. */
+
+struct csim_cache {
+    struct cache_model *cache;
+    struct address_decoder decoder;
+    int model_writes;
+    unsigned long accesses_count;
+};
+
+struct csim_cache *csim_create(const struct csim_config *config) {
+/*
+    Function to create a cache from its configuration. Returns NULL if
+    the configuration is not valid.
+*/
+    struct csim_cache *csim;
+    struct cache_geometry geometry;
+    const struct replacement_policy *policy = DEFAULT_POLICY;
+    if (config->set_bits_num < 0 || config->set_bits_num > NUMERICAL_PARAM_MAX
+            || config->associativity_num < 1 || config->associativity_num > MAX_ASSOCIATIVITY
+            || config->block_bits_num < 0 || config->block_bits_num > NUMERICAL_PARAM_MAX
+            || config->set_bits_num + config->block_bits_num >= ADDRESS_BIT_LENGTH) {
+        return NULL;
     }
-    /* We will be nullifying the age of the cache entry here */
-    nullify_age(cache, set_index, found_line_index);
-    return 1;
+    if (NULL != config->policy) {
+        policy = find_replacement_policy(config->policy);
+        if (NULL == policy) {
+            return NULL;
+        }
+    }
+    if (!is_policy_geometry_valid(policy, config->associativity_num)) {
+        return NULL;
+    }
+    geometry.set_index_bits_num = config->set_bits_num;
+    geometry.associativity_num = config->associativity_num;
+    geometry.block_bits_num = config->block_bits_num;
+
+    csim = malloc(sizeof(struct csim_cache));
+    assert(NULL != csim);
+    csim->cache = create_cache_model(geometry, policy, config->seed);
+    csim->decoder = create_address_decoder(geometry);
+    csim->model_writes = config->model_writes;
+    if (config->model_writes) {
+        allocate_dirty_lines(csim->cache);
+        csim->cache->write_policy.write_back = config->write_back;
+        csim->cache->write_policy.write_allocate = config->write_allocate;
+    }
+    csim->accesses_count = 0;
+    return csim;
 }
 
-int is_in_cache(long int address, struct cache_model *cache, struct passed_args *args) {
+int csim_access(struct csim_cache *csim, enum csim_operation operation,
+                unsigned long address, unsigned int size) {
 /*
-    Function to check if the data stored at the given address is in the cache
-    (external)
+    Function to simulate an access. Returns the number of misses it caused.
 */
-    struct address_separated *addr_sep = separate_address(address, args);
-    long set_index = addr_sep->set_index;
-    long line_tag = addr_sep->line_index;
-    int is_valid = check_validity(cache, set_index, line_tag);
-    free(addr_sep);
-    return is_valid;
+    struct file_line access;
+    unsigned long misses_count = csim->cache->statistics.misses;
+    access.operation = (CSIM_LOAD == operation) ? L : ((CSIM_STORE == operation) ? S : M);
+    access.address = address;
+    access.size = size;
+    if (csim->model_writes) {
+        csim->accesses_count += make_cache_operation_step(&access, csim->cache, csim->decoder);
+    } else {
+        make_cache_step(access.address, csim->cache, csim->decoder);
+        csim->accesses_count++;
+        if (M == access.operation) {
+            make_cache_step(access.address, csim->cache, csim->decoder);
+            csim->accesses_count++;
+        }
+    }
+    return csim->cache->statistics.misses - misses_count;
 }
 
-void make_cache_step(long int address, struct cache_model *cache, struct passed_args *args) {
+unsigned long csim_access_batch(struct csim_cache *csim,
+                                const struct csim_memory_access *accesses,
+                                unsigned long accesses_num) {
 /*
-    A main function to process the lines of the trace file in a sequential way
+    Function to simulate accesses in order. Returns the number of misses they caused.
 */
-    age_cache(cache);
-    if (is_in_cache(address, cache, args)) {
-        cache_hits += 1;
-        return;
+    unsigned long misses_count = 0;
+    unsigned long i;
+    for (i = 0; i < accesses_num; i++) {
+        misses_count += csim_access(csim, accesses[i].operation, accesses[i].address,
+                                    accesses[i].size);
     }
-    cache_misses += 1;
-    add_to_cache(address, cache, args);
+    return misses_count;
 }
 
-/* END OF CACHE MANIPULATION SECTION  */
+struct csim_statistics csim_stats(const struct csim_cache *csim) {
+    struct csim_statistics statistics;
+    statistics.accesses = csim->accesses_count;
+    statistics.hits = csim->cache->statistics.hits;
+    statistics.misses = csim->cache->statistics.misses;
+    statistics.evictions = csim->cache->statistics.evictions;
+    statistics.writebacks = csim->cache->write_statistics.writebacks;
+    statistics.bytes_read = csim->cache->write_statistics.bytes_read;
+    statistics.bytes_written = csim->cache->write_statistics.bytes_written;
+    return statistics;
+}
+
+void csim_destroy(struct csim_cache *csim) {
+    destroy_cache_model(csim->cache);
+    free(csim);
+}
+
+/* END OF LIBRARY SECTION */
 
 
+#ifndef CSIM_LIBRARY
+
 int main (int argc, char * argv[])
 {
     struct passed_args *args = parse_passed_arguments(argc, argv);
-    struct file_line *lines;
-    struct cache_model *cache = create_cache_model(args);
-    int lines_count;
-    int i = 0;
+    struct trace_reader *reader;
+    struct file_line access;
+    struct cache_model *cache;
+    struct address_decoder decoder;
+    struct cache_statistics statistics;
+    struct prefetcher *prefetcher = NULL;
+    struct window_stream *windows = NULL;
+    struct cache_model *victim = NULL;
+    struct tlb *tlb = NULL;
+    struct cache_model *icache = NULL;
+    struct address_decoder icache_decoder;
+    struct cache_statistics fetch_statistics = {0, 0, 0};
+    unsigned long accesses_count = 0;
+    /* Fetches simulated by the separate instruction cache: they are not part
+        of the windows, which show the accesses to the cache of -s, -E, -b */
+    unsigned long icache_accesses_count = 0;
+    unsigned long misses_count;
+    double start_time;
 
     /* If help flag was passed, print the help message and stop execution */
     if (args->help_flag) {
         print_help();
         return 0;
     }
-    lines_count = count_lines_to_regard(args->trace_file);
-    lines = process_trace_file(args->trace_file, lines_count);
-    for (i = 0; i < lines_count; i++) {
-        make_cache_step(lines[i].address, cache, args);
-        if (M == lines[i].operation) {
-            make_cache_step(lines[i].address, cache, args);
+    start_time = get_time_seconds();
+    if (NO_PATTERN != args->trace_pattern || args->benchmark_flag) {
+        if (NO_PATTERN != args->trace_pattern) {
+            accesses_count = generate_trace(args);
+        } else {
+            accesses_count = run_benchmark(args);
+        }
+        if (args->performance_flag) {
+            print_performance(accesses_count, get_time_seconds() - start_time);
+        }
+        return 0;
+    }
+
+    if (!is_single_geometry_mode(args) || args->policies_num > 1) {
+        if (NULL != args->convert_file) {
+            accesses_count = convert_trace(args->trace_file, args->convert_file);
+        } else if (args->levels_num > 0) {
+            accesses_count = run_hierarchy(args);
+        } else if (args->sweep_geometries_num > 0 || args->policies_num > 1) {
+            accesses_count = run_sweep(args);
+        } else {
+            accesses_count = run_stack_distance(args);
+        }
+        if (args->performance_flag) {
+            print_performance(accesses_count, get_time_seconds() - start_time);
+        }
+        return 0;
+    }
+
+    if (args->classify_flag || args->trace_files_num > 1 || args->sample_rate > 1) {
+        if (args->classify_flag) {
+            accesses_count = run_miss_classification(args);
+        } else if (args->sample_rate > 1) {
+            accesses_count = run_set_sampling(args);
+        } else {
+            accesses_count = run_multicore(args);
+        }
+        if (args->performance_flag) {
+            print_performance(accesses_count, get_time_seconds() - start_time);
+        }
+        return 0;
+    }
+
+    if (args->pipeline_parsers_num > 0 || args->threads_num > 1) {
+        if (args->pipeline_parsers_num > 0) {
+            statistics = run_pipeline(args, &accesses_count);
+        } else {
+            statistics = run_set_shards(args, &accesses_count);
+        }
+        printSummary(statistics.hits, statistics.misses, statistics.evictions);
+        if (args->performance_flag) {
+            print_performance(accesses_count, get_time_seconds() - start_time);
+        }
+        return 0;
+    }
+
+    cache = create_cache_model(get_cache_geometry(args), get_first_policy(args), args->seed);
+    cache->write_policy = args->write_policy;
+    if (args->write_modeling_flag) {
+        allocate_dirty_lines(cache);
+    }
+    decoder = create_address_decoder(get_cache_geometry(args));
+    if (NO_PREFETCHER != args->prefetcher_kind) {
+        prefetcher = create_prefetcher(args->prefetcher_kind, args->prefetch_degree,
+                                        args->prefetch_latency);
+        allocate_prefetch_state(cache);
+    }
+    if (args->window_size > 0) {
+        windows = open_window_stream(args, cache->number_of_sets);
+    }
+    if (args->victim_lines_num > 0) {
+        victim = create_victim_cache(args->victim_lines_num);
+    }
+    if (args->tlb_levels_num > 0) {
+        tlb = create_tlb(args);
+    }
+    if (args->instructions_flag && !args->unified_flag) {
+        icache = create_cache_model(args->icache_geometry, get_first_policy(args), args->seed);
+        icache_decoder = create_address_decoder(args->icache_geometry);
+    }
+    reader = open_trace_reader(args->trace_file);
+    reader->instructions_flag = args->instructions_flag;
+    while (read_next_access(reader, &access)) {
+        misses_count = cache->statistics.misses;
+        if (I == access.operation) {
+            if (NULL != icache) {
+                make_instruction_fetch_step(access.address, icache, NULL, icache_decoder,
+                                            &fetch_statistics);
+                icache_accesses_count++;
+            } else {
+                make_instruction_fetch_step(access.address, cache, victim, decoder,
+                                            &fetch_statistics);
+            }
+            accesses_count++;
+        } else if (args->write_modeling_flag) {
+            accesses_count += make_cache_operation_step(&access, cache, decoder);
+        } else if (NULL != victim) {
+            make_victim_cache_step(access.address, cache, victim, decoder);
+            accesses_count++;
+            if (M == access.operation) {
+                make_victim_cache_step(access.address, cache, victim, decoder);
+                accesses_count++;
+            }
+        } else {
+            make_cache_step(access.address, cache, decoder);
+            accesses_count++;
+            if (M == access.operation) {
+                make_cache_step(access.address, cache, decoder);
+                accesses_count++;
+            }
+        }
+        if (NULL != tlb) {
+            make_tlb_step(tlb, access.address);
+            if (M == access.operation) {
+                make_tlb_step(tlb, access.address);
+            }
+        }
+        if (NULL != prefetcher && I != access.operation) {
+            make_prefetch_step(prefetcher, cache, decoder, access.address,
+                                misses_count != cache->statistics.misses);
         }
+        if (NULL != windows) {
+            advance_window_stream(windows, cache, accesses_count - icache_accesses_count);
+        }
+    }
+    close_trace_reader(reader);
+    if (NULL != windows) {
+        close_window_stream(windows, cache, accesses_count - icache_accesses_count);
     }
     
-    printSummary(cache_hits, cache_misses, cache_evictions);
+    printSummary(cache->statistics.hits, cache->statistics.misses, cache->statistics.evictions);
+    if (args->write_modeling_flag) {
+        printf("writebacks:%lu bytes_read:%lu bytes_written:%lu\n",
+                cache->write_statistics.writebacks, cache->write_statistics.bytes_read,
+                cache->write_statistics.bytes_written);
+    }
+    if (NULL != prefetcher) {
+        print_prefetch_statistics(cache);
+        free(prefetcher);
+    }
+    print_victim_and_tlb_statistics(victim, tlb);
+    if (args->instructions_flag) {
+        printf("ifetch hits:%lu misses:%lu evictions:%lu\n",
+                fetch_statistics.hits, fetch_statistics.misses, fetch_statistics.evictions);
+    }
+    if (NULL != icache) {
+        destroy_cache_model(icache);
+    }
+    if (NULL != victim) {
+        destroy_cache_model(victim);
+    }
+    if (NULL != tlb) {
+        destroy_tlb(tlb);
+    }
+    destroy_cache_model(cache);
+    if (args->performance_flag) {
+        print_performance(accesses_count, get_time_seconds() - start_time);
+    }
     return 0;
 }
+
+#endif
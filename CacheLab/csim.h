@@ -0,0 +1,80 @@
+/*
+******************************
+* Sergey SHPAK, sergey.shpak *
+******************************
+*/
+
+/*
+ * csim.h - Embeddable interface of the cache simulator
+ *
+ * csim.c built with -DCSIM_LIBRARY has no main and can be linked with other
+ * programs (needing only the C library), which feed their addresses to the
+ * cache model directly instead of writing and replaying trace files.
+ * Every cache is independent, the library has no global state, so several
+ * caches can be simulated at once, each one by a single thread.
+ */
+#ifndef CSIM_H
+#define CSIM_H
+
+/* Operations of the simulated accesses, as in the valgrind traces */
+enum csim_operation {CSIM_LOAD, CSIM_STORE, CSIM_MODIFY};
+
+struct csim_config {
+/*
+    Structure to describe a simulated cache: its geometry (as the -s, -E and -b
+    options), the name of its replacement policy (NULL for LRU), the seed of the
+    random policy and its write policy. Stores are simulated as loads, like
+    without the -w option, unless model_writes is set.
+*/
+    int set_bits_num;
+    int associativity_num;
+    int block_bits_num;
+    const char *policy;
+    unsigned long seed;
+    int model_writes;
+    int write_back;
+    int write_allocate;
+};
+
+struct csim_memory_access {
+/*
+    Structure to describe an access passed to csim_access_batch.
+*/
+    enum csim_operation operation;
+    unsigned long address;
+    unsigned int size;  // number of bytes accessed
+};
+
+struct csim_statistics {
+/*
+    Structure where the results of the simulation are returned.
+    A modification counts as two accesses.
+*/
+    unsigned long accesses;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long writebacks;
+    unsigned long bytes_read;
+    unsigned long bytes_written;
+};
+
+struct csim_cache;
+
+/* Returns a new cache or NULL if the configuration is not valid */
+struct csim_cache *csim_create(const struct csim_config *config);
+
+/* Simulates an access, returns the number of misses it caused */
+int csim_access(struct csim_cache *cache, enum csim_operation operation,
+                unsigned long address, unsigned int size);
+
+/* Simulates accesses_num accesses, returns the number of misses they caused */
+unsigned long csim_access_batch(struct csim_cache *cache,
+                                const struct csim_memory_access *accesses,
+                                unsigned long accesses_num);
+
+struct csim_statistics csim_stats(const struct csim_cache *cache);
+
+void csim_destroy(struct csim_cache *cache);
+
+#endif